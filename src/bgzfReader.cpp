@@ -0,0 +1,335 @@
+/*
+ * File: bgzfReader.cpp
+ *
+ * Reads BGZF files, inflating blocks in parallel
+ * See: the SAM/BAM format specification, section 4.1
+ *
+ */
+
+#include "bgzfReader.hpp"
+
+#include <cstring>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <zlib.h>
+
+// Number of blocks (of up to 64kb) each thread inflates per batch
+const unsigned int bgzf_blocks_per_thread = 16;
+
+// gzip header, with the BC subfield bgzip writes first
+const size_t bgzf_header_size = 18;
+const unsigned char bgzf_magic[] = {0x1f, 0x8b, 0x08, 0x04};
+const unsigned char bgzf_subfield[] = {'B', 'C', 0x02, 0x00};
+
+// Whether h, of at least bgzf_header_size bytes, is the start of a BGZF block
+static int isBlockHeader(const unsigned char* h)
+{
+   return memcmp(h, bgzf_magic, 4) == 0 && memcmp(h + 12, bgzf_subfield, 4) == 0;
+}
+
+// Reads the next block from the file. Returns 0 at the end of the file
+static int readBlock(std::ifstream& file, BgzfBlock& block)
+{
+   unsigned char header[bgzf_header_size];
+   block.offset = file.tellg();
+   file.read(reinterpret_cast<char*>(header), bgzf_header_size);
+   if (file.gcount() == 0)
+   {
+      return 0;
+   }
+   else if (file.gcount() < (std::streamsize)bgzf_header_size || !isBlockHeader(header))
+   {
+      throw std::runtime_error("Not a BGZF block at offset " + std::to_string(block.offset));
+   }
+
+   // Total block size is BSIZE + 1. Any further subfields are skipped over
+   const size_t extra_length = header[10] | (header[11] << 8);
+   const size_t block_size = (header[16] | (header[17] << 8)) + 1;
+   const size_t header_length = 12 + extra_length;
+
+   if (extra_length > 6)
+   {
+      file.ignore(extra_length - 6);
+   }
+
+   block.compressed.resize(block_size - header_length);
+   file.read(&block.compressed[0], block.compressed.size());
+   if (file.gcount() < (std::streamsize)block.compressed.size())
+   {
+      throw std::runtime_error("Truncated BGZF block at offset " + std::to_string(block.offset));
+   }
+
+   return 1;
+}
+
+// Inflates the raw deflate data of a block, checking against the CRC32 and
+// size at its end
+static void inflateBlock(BgzfBlock& block)
+{
+   const unsigned char* footer = reinterpret_cast<const unsigned char*>(block.compressed.data()) + block.compressed.size() - 8;
+   const uint32_t crc = footer[0] | (footer[1] << 8) | (footer[2] << 16) | ((uint32_t)footer[3] << 24);
+   const uint32_t inflated_size = footer[4] | (footer[5] << 8) | (footer[6] << 16) | ((uint32_t)footer[7] << 24);
+
+   block.data.resize(inflated_size);
+
+   z_stream stream;
+   memset(&stream, 0, sizeof(stream));
+   stream.next_in = reinterpret_cast<Bytef*>(&block.compressed[0]);
+   stream.avail_in = block.compressed.size() - 8;
+   stream.next_out = reinterpret_cast<Bytef*>(&block.data[0]);
+   stream.avail_out = inflated_size;
+
+   int status = inflateInit2(&stream, -15);
+   if (status == Z_OK)
+   {
+      status = inflate(&stream, Z_FINISH);
+      inflateEnd(&stream);
+   }
+
+   if (status != Z_STREAM_END || stream.total_out != inflated_size
+         || crc32(crc32(0L, Z_NULL, 0), reinterpret_cast<const Bytef*>(block.data.data()), inflated_size) != crc)
+   {
+      throw std::runtime_error("Corrupt BGZF block at offset " + std::to_string(block.offset));
+   }
+
+   block.compressed.clear();
+}
+
+BgzfReader::BgzfReader(const std::string& file_name, const unsigned int threads, const uint64_t start, const uint64_t end)
+   :_threads(threads > 0 ? threads : 1), _end(end), _eof(0), _block(0), _pos(0)
+{
+   _file.open(file_name.c_str(), std::ios::in | std::ios::binary);
+   if (!_file)
+   {
+      throw std::runtime_error("Could not open kmer file " + file_name + "\n");
+   }
+
+   const uint64_t begin = resync(start);
+   if (end != bgzf_no_end)
+   {
+      _end = resync(end);
+   }
+
+   _file.clear();
+   _file.seekg(begin >> 16);
+   _batch = readBatch();
+   _next_batch = std::async(std::launch::async, &BgzfReader::readBatch, this);
+
+   // Lines before the start belong to the previous range
+   _pos = begin & 0xffff;
+   if (begin != 0)
+   {
+      const char* line;
+      size_t length;
+      next_line(line, length);
+   }
+}
+
+BgzfReader::~BgzfReader()
+{
+   if (_next_batch.valid())
+   {
+      _next_batch.wait();
+   }
+}
+
+int BgzfReader::isBgzf(const std::string& file_name)
+{
+   int bgzf = 0;
+
+   // Reading the header would take it from a pipe
+   struct stat file_info;
+   if (stat(file_name.c_str(), &file_info) == 0 && S_ISREG(file_info.st_mode))
+   {
+      std::ifstream file(file_name.c_str(), std::ios::in | std::ios::binary);
+
+      unsigned char header[bgzf_header_size];
+      file.read(reinterpret_cast<char*>(header), bgzf_header_size);
+
+      bgzf = file.gcount() == (std::streamsize)bgzf_header_size && isBlockHeader(header);
+   }
+
+   return bgzf;
+}
+
+bool BgzfReader::next_line(const char*& line, size_t& length)
+{
+   _line_buffer.clear();
+
+   int found = 0, started = 0, spanning = 0;
+   while (!found && !_eof)
+   {
+      // Move on to the next block with data left
+      if (_block < _batch.size() && _pos >= _batch[_block].data.size())
+      {
+         ++_block;
+         _pos = 0;
+         continue;
+      }
+      else if (_block >= _batch.size())
+      {
+         if (!nextBlock())
+         {
+            _eof = 1;
+            break;
+         }
+         continue;
+      }
+
+      const BgzfBlock& block = _batch[_block];
+      if (!started)
+      {
+         started = 1;
+         if (((block.offset << 16) | _pos) > _end)
+         {
+            _eof = 1;
+            break;
+         }
+      }
+
+      const char* start = block.data.data() + _pos;
+      const size_t remaining = block.data.size() - _pos;
+      const char* line_end = static_cast<const char*>(memchr(start, '\n', remaining));
+      if (line_end == NULL)
+      {
+         _line_buffer.append(start, remaining);
+         spanning = 1;
+         _pos += remaining;
+      }
+      else
+      {
+         const size_t line_length = line_end - start;
+         _pos += line_length + 1;
+         found = 1;
+
+         if (spanning)
+         {
+            _line_buffer.append(start, line_length);
+            line = _line_buffer.data();
+            length = _line_buffer.size();
+         }
+         else
+         {
+            line = start;
+            length = line_length;
+         }
+      }
+   }
+
+   // Last line, without a newline
+   if (!found && spanning)
+   {
+      line = _line_buffer.data();
+      length = _line_buffer.size();
+      found = 1;
+   }
+
+   return found;
+}
+
+// Swaps in the batch being inflated in the background, and starts on the
+// one after. Returns 0 at the end of the file
+int BgzfReader::nextBlock()
+{
+   _batch = _next_batch.get();
+   _block = 0;
+   _pos = 0;
+
+   int more = !_batch.empty();
+   if (more)
+   {
+      _next_batch = std::async(std::launch::async, &BgzfReader::readBatch, this);
+   }
+
+   return more;
+}
+
+// Reads the next batch of blocks, and inflates them split between the
+// threads
+std::vector<BgzfBlock> BgzfReader::readBatch()
+{
+   std::vector<BgzfBlock> batch;
+   const size_t batch_size = _threads * bgzf_blocks_per_thread;
+   batch.reserve(batch_size);
+
+   BgzfBlock block;
+   while (batch.size() < batch_size && readBlock(_file, block))
+   {
+      batch.push_back(std::move(block));
+   }
+
+   const size_t per_thread = (batch.size() + _threads - 1) / _threads;
+   std::vector<std::future<void>> inflating;
+   for (size_t first = 0; first < batch.size(); first += per_thread)
+   {
+      const size_t last = std::min(first + per_thread, batch.size());
+      inflating.push_back(std::async(std::launch::async, [&batch, first, last]()
+      {
+         for (size_t i = first; i < last; ++i)
+         {
+            inflateBlock(batch[i]);
+         }
+      }));
+   }
+
+   // Rethrows any errors
+   for (auto it = inflating.begin(); it != inflating.end(); ++it)
+   {
+      it->get();
+   }
+
+   return batch;
+}
+
+// Moves a virtual offset whose compressed offset is not the start of a block
+// forward to the start of the next block
+uint64_t BgzfReader::resync(const uint64_t virtual_offset)
+{
+   uint64_t offset = virtual_offset >> 16;
+
+   _file.clear();
+   _file.seekg(0, std::ios::end);
+   const uint64_t file_size = _file.tellg();
+
+   uint64_t synced = file_size << 16;
+   if (offset < file_size)
+   {
+      // Search forward a chunk at a time. Chunks overlap so headers across a
+      // boundary are found
+      std::vector<unsigned char> chunk(1 << 16);
+      int found = 0;
+      while (!found && offset < file_size)
+      {
+         _file.clear();
+         _file.seekg(offset);
+         _file.read(reinterpret_cast<char*>(&chunk[0]), chunk.size());
+         const size_t chunk_read = _file.gcount();
+
+         size_t i = 0;
+         for (; i + bgzf_header_size <= chunk_read; ++i)
+         {
+            if (isBlockHeader(&chunk[i]))
+            {
+               found = 1;
+               break;
+            }
+         }
+
+         if (found)
+         {
+            // Start of a block as given keeps its offset within the block
+            synced = i == 0 && offset == (virtual_offset >> 16) ? virtual_offset : (offset + i) << 16;
+         }
+         else if (chunk_read < bgzf_header_size)
+         {
+            break;
+         }
+         else
+         {
+            offset += chunk_read - bgzf_header_size + 1;
+         }
+      }
+   }
+
+   return synced;
+}
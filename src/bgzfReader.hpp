@@ -0,0 +1,67 @@
+/*
+ * bgzfReader.hpp
+ * Header file for bgzfReader class
+ */
+
+#include <cstdint>
+#include <fstream>
+#include <future>
+#include <limits>
+#include <string>
+#include <vector>
+
+// Reading beyond this virtual offset stops at the end of the file
+const uint64_t bgzf_no_end = std::numeric_limits<uint64_t>::max();
+
+// One block of a BGZF file, as read and once inflated
+struct BgzfBlock
+{
+   uint64_t offset; // in the compressed file
+   std::string compressed;
+   std::string data;
+};
+
+// Reads lines of a BGZF (blocked gzip, as made by bgzip) file. Blocks are
+// inflated in batches over several threads, while the previous batch is read
+//
+// A range of the file can be read by giving the virtual offsets (compressed
+// offset << 16 | offset within the block) to start and end at. If the start
+// is not at the start of the file the first, possibly partial, line is
+// skipped; lines starting at or before the end are read. Consecutive ranges
+// therefore read every line exactly once. Compressed offsets which are not
+// at the start of a block are moved forward to the next block
+class BgzfReader
+{
+   public:
+      // Initialisation
+      BgzfReader(const std::string& file_name, const unsigned int threads = 1, const uint64_t start = 0, const uint64_t end = bgzf_no_end);
+      ~BgzfReader();
+
+      // Modifying operations
+      // The line is valid until the next call. Returns false at the end of
+      // the file or range
+      bool next_line(const char*& line, size_t& length); // this is defined in bgzfReader.cpp
+
+      // Whether a file starts with a BGZF block header
+      static int isBgzf(const std::string& file_name); // this is defined in bgzfReader.cpp
+
+   private:
+      BgzfReader(const BgzfReader&);
+      BgzfReader& operator=(const BgzfReader&);
+
+      std::vector<BgzfBlock> readBatch();
+      int nextBlock();
+      uint64_t resync(const uint64_t virtual_offset);
+
+      std::ifstream _file;
+      unsigned int _threads;
+      uint64_t _end;
+      int _eof;
+
+      std::vector<BgzfBlock> _batch;
+      std::future<std::vector<BgzfBlock>> _next_batch;
+      size_t _block; // in _batch
+      size_t _pos; // in the data of _block
+
+      std::string _line_buffer; // for lines which span blocks
+};
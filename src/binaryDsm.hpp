@@ -0,0 +1,49 @@
+/*
+ * binaryDsm.hpp
+ * Header file for the binary dsm format, as written by dsm2bin
+ */
+
+#include <cstdint>
+#include <string>
+
+// Layout of a binary dsm file, in native (little endian) byte order:
+//
+//    header      BinaryDsmHeader
+//    samples     num_samples sorted names, each a uint32 length then the name
+//    records     one per k-mer, each starting on an 8 byte boundary:
+//                   uint32 sequence length, with binary_dsm_text_sequence set
+//                      if the sequence is not all ACGT and is stored as is
+//                   sequence, four bases to a byte with the first in the low
+//                      bits (A=0 C=1 G=2 T=3)
+//                   presence, ceil(num_samples / 64) uint64 words on an 8
+//                      byte boundary, bit i for sample i
+//                   if binary_dsm_counts is set, a uint32 count for each
+//                      present sample in order
+//    index       num_kmers uint64 offsets of the records
+//
+// The header is written again once the records are, with the number of
+// k-mers and the offset of the index filled in
+const char binary_dsm_magic[8] = {'S', 'E', 'E', 'R', 'D', 'S', 'M', 0};
+const uint32_t binary_dsm_version = 1;
+
+//    Flags
+const uint32_t binary_dsm_counts = 1;
+const uint32_t binary_dsm_text_sequence = 0x80000000;
+
+const size_t binary_dsm_alignment = 8;
+
+struct BinaryDsmHeader
+{
+   char magic[8];
+   uint32_t version;
+   uint32_t flags;
+   uint64_t num_samples;
+   uint64_t num_kmers;
+   uint64_t index_offset;
+};
+
+// Bytes needed to pad length to the record alignment
+inline size_t binaryDsmPadding(const size_t length)
+{
+   return (binary_dsm_alignment - length % binary_dsm_alignment) % binary_dsm_alignment;
+}
@@ -0,0 +1,291 @@
+/*
+ * File: binaryDsmReader.cpp
+ *
+ * Reads binary dsm files written by dsm2bin, memory mapping them
+ *
+ */
+
+#include "seercommon.hpp"
+
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+const char binary_dsm_bases[] = {'A', 'C', 'G', 'T'};
+
+// Offset of the presence row in a record, after the sequence
+size_t presenceOffset(const char* record)
+{
+   uint32_t length;
+   memcpy(&length, record, sizeof(uint32_t));
+   size_t sequence_bytes = length & binary_dsm_text_sequence ? length & ~binary_dsm_text_sequence : (length + 3) / 4;
+   size_t presence_offset = sizeof(uint32_t) + sequence_bytes;
+   presence_offset += binaryDsmPadding(presence_offset);
+
+   return presence_offset;
+}
+
+BinaryDsmReader::BinaryDsmReader(const std::string& file_name, const uint64_t start, const uint64_t end)
+   :_fd(-1), _data(NULL), _size(0), _header(NULL), _index(NULL), _presence_words(0), _next(0), _last(0),
+   _record(NULL), _record_length(0), _records_offset(0), _mapped_samples(NULL), _same_samples(0)
+{
+   _fd = open(file_name.c_str(), O_RDONLY);
+   struct stat file_info;
+   if (_fd == -1 || fstat(_fd, &file_info) != 0)
+   {
+      if (_fd != -1)
+      {
+         close(_fd);
+      }
+      throw std::runtime_error("Could not open kmer file " + file_name + "\n");
+   }
+
+   _size = file_info.st_size;
+   if (_size < sizeof(BinaryDsmHeader))
+   {
+      close(_fd);
+      throw std::runtime_error("Binary kmer file " + file_name + " is truncated\n");
+   }
+
+   void* mapping = mmap(NULL, _size, PROT_READ, MAP_PRIVATE, _fd, 0);
+   if (mapping == MAP_FAILED)
+   {
+      close(_fd);
+      throw std::runtime_error("Could not map kmer file " + file_name + "\n");
+   }
+   madvise(mapping, _size, MADV_SEQUENTIAL);
+   _data = static_cast<const char*>(mapping);
+
+   // The number of k-mers and index are only filled in once the file has
+   // been completely written
+   _header = reinterpret_cast<const BinaryDsmHeader*>(_data);
+   if (_header->version != binary_dsm_version)
+   {
+      unreadable("Binary kmer file " + file_name + " has unsupported version " + std::to_string(_header->version) + "\n");
+   }
+   else if (_header->index_offset == 0)
+   {
+      unreadable("Binary kmer file " + file_name + " is incomplete. Run dsm2bin again\n");
+   }
+   // Everything read from the mapping must lie within it
+   else if (_header->index_offset < sizeof(BinaryDsmHeader) || _header->index_offset > _size
+         || _header->index_offset % binary_dsm_alignment != 0
+         || _header->num_kmers > (_size - _header->index_offset) / sizeof(uint64_t)
+         || _header->num_samples > (_header->index_offset - sizeof(BinaryDsmHeader)) / sizeof(uint32_t))
+   {
+      unreadable("Binary kmer file " + file_name + " is corrupt\n");
+   }
+
+   std::vector<std::string> names;
+   names.reserve(_header->num_samples);
+   const char* pos = _data + sizeof(BinaryDsmHeader);
+   const char* names_end = _data + _header->index_offset;
+   for (uint64_t i = 0; i < _header->num_samples; ++i)
+   {
+      uint32_t length = 0;
+      if ((size_t)(names_end - pos) >= sizeof(uint32_t))
+      {
+         memcpy(&length, pos, sizeof(uint32_t));
+      }
+      if ((size_t)(names_end - pos) < sizeof(uint32_t) + (size_t)length)
+      {
+         unreadable("Binary kmer file " + file_name + " is corrupt\n");
+      }
+
+      names.push_back(std::string(pos + sizeof(uint32_t), length));
+      pos += sizeof(uint32_t) + length;
+   }
+   _records_offset = pos - _data;
+   _samples = SampleIndex(names);
+   _presence_words = (_header->num_samples + 63) / 64;
+
+   // Records in the range, from the index
+   _index = reinterpret_cast<const uint64_t*>(_data + _header->index_offset);
+   _next = std::lower_bound(_index, _index + _header->num_kmers, start) - _index;
+   _last = std::lower_bound(_index, _index + _header->num_kmers, end) - _index;
+}
+
+BinaryDsmReader::~BinaryDsmReader()
+{
+   if (_data != NULL)
+   {
+      munmap(const_cast<char*>(_data), _size);
+   }
+   close(_fd);
+}
+
+// The destructor is not run when the constructor throws, so the file is
+// unmapped and closed here first
+void BinaryDsmReader::unreadable(const std::string& message)
+{
+   munmap(const_cast<char*>(_data), _size);
+   close(_fd);
+   _data = NULL;
+   _fd = -1;
+
+   throw std::runtime_error(message);
+}
+
+int BinaryDsmReader::isBinaryDsm(const std::string& file_name)
+{
+   int binary = 0;
+
+   // Binary files are memory mapped, so are never pipes
+   if (regularFile(file_name))
+   {
+      std::ifstream file(file_name.c_str(), std::ios::in | std::ios::binary);
+
+      char magic[sizeof(binary_dsm_magic)];
+      file.read(magic, sizeof(magic));
+
+      binary = file.gcount() == sizeof(magic) && memcmp(magic, binary_dsm_magic, sizeof(magic)) == 0;
+   }
+
+   return binary;
+}
+
+bool BinaryDsmReader::next_record()
+{
+   bool read = false;
+   if (_next < _last)
+   {
+      const uint64_t record_end = _next + 1 < _header->num_kmers ? _index[_next + 1] : _header->index_offset;
+      if (!validRecord(_index[_next], record_end))
+      {
+         throw std::runtime_error("Binary kmer file has a corrupt index entry for k-mer " + std::to_string(_next + 1) + "\n");
+      }
+
+      _record = _data + _index[_next];
+      _record_length = record_end - _index[_next];
+      ++_next;
+      read = true;
+   }
+
+   return read;
+}
+
+// Whether a record lies between the sample names and the index, and is long
+// enough for its sequence, presence row and counts. Records are read where
+// they lie, so a corrupt index must not lead outside the file
+int BinaryDsmReader::validRecord(const uint64_t start, const uint64_t end) const
+{
+   int valid = start >= _records_offset && start % binary_dsm_alignment == 0
+      && end >= start && end <= _header->index_offset && end - start >= sizeof(uint32_t);
+   if (valid)
+   {
+      const size_t presence_end = presenceOffset(_data + start) + _presence_words * sizeof(uint64_t);
+      valid = presence_end <= end - start;
+
+      if (valid && has_counts())
+      {
+         const uint64_t* words = reinterpret_cast<const uint64_t*>(_data + start + presence_end) - _presence_words;
+         size_t present = 0;
+         for (size_t w = 0; w < _presence_words; ++w)
+         {
+            present += __builtin_popcountll(words[w]);
+         }
+         valid = presence_end + present * sizeof(uint32_t) <= end - start;
+      }
+   }
+
+   return valid;
+}
+
+// Unpacks the sequence of the current record
+std::string BinaryDsmReader::sequence() const
+{
+   uint32_t length;
+   memcpy(&length, _record, sizeof(uint32_t));
+   const unsigned char* packed = reinterpret_cast<const unsigned char*>(_record + sizeof(uint32_t));
+
+   std::string sequence;
+   if (length & binary_dsm_text_sequence)
+   {
+      sequence.assign(reinterpret_cast<const char*>(packed), length & ~binary_dsm_text_sequence);
+   }
+   else
+   {
+      sequence.resize(length);
+      for (uint32_t i = 0; i < length; ++i)
+      {
+         sequence[i] = binary_dsm_bases[(packed[i >> 2] >> ((i & 3) << 1)) & 3];
+      }
+   }
+
+   return sequence;
+}
+
+// Sets the k-mer to the current record, with presence for the samples in the
+// pheno file. If counts is given it is set to the count in each of these
+// samples (1 if the file has no counts). If dropped is given, occurrences in
+// samples not in the pheno file are added to it
+void BinaryDsmReader::parse(Kmer& k, const SampleIndex& samples, std::vector<unsigned int>* counts, long int* dropped) const
+{
+   if (_mapped_samples != &samples)
+   {
+      mapSamples(samples);
+   }
+
+   // Find the presence row and counts after the sequence
+   const uint64_t* words = reinterpret_cast<const uint64_t*>(_record + presenceOffset(_record));
+   const uint32_t* record_counts = reinterpret_cast<const uint32_t*>(words + _presence_words);
+
+   if (counts != NULL)
+   {
+      counts->assign(samples.size(), 0);
+   }
+
+   BitVector presence;
+   if (_same_samples && counts == NULL)
+   {
+      presence = BitVector(_header->num_samples, words);
+   }
+   else
+   {
+      presence = BitVector(samples.size());
+
+      size_t present = 0;
+      for (size_t w = 0; w < _presence_words; ++w)
+      {
+         uint64_t word = words[w];
+         while (word)
+         {
+            const int sample_index = _sample_map[(w << 6) + __builtin_ctzll(word)];
+            if (sample_index >= 0)
+            {
+               presence.set(sample_index);
+               if (counts != NULL)
+               {
+                  (*counts)[sample_index] = has_counts() ? record_counts[present] : 1;
+               }
+            }
+            else if (dropped != NULL)
+            {
+               (*dropped)++;
+            }
+
+            ++present;
+            word &= word - 1;
+         }
+      }
+   }
+
+   k = Kmer(sequence(), kmer_occ_default);
+   k.add_x(presence);
+}
+
+// Resolves the samples in the file to those in the pheno file
+void BinaryDsmReader::mapSamples(const SampleIndex& samples) const
+{
+   _same_samples = samples == _samples;
+
+   _sample_map.resize(_samples.size());
+   for (size_t i = 0; i < _samples.size(); ++i)
+   {
+      const std::string name = _samples.name(i);
+      _sample_map[i] = samples.find(name.data(), name.size());
+   }
+
+   _mapped_samples = &samples;
+}
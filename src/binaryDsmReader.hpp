@@ -0,0 +1,67 @@
+/*
+ * binaryDsmReader.hpp
+ * Header file for binaryDsmReader class
+ */
+
+#include <string>
+#include <vector>
+
+// Reads a binary dsm file (see binaryDsm.hpp) record by record. The file is
+// memory mapped, and presence rows are used as they lie when the file has
+// the same samples as the pheno file
+//
+// A range of the file can be read by giving byte offsets: records starting
+// at or after the start and before the end are read
+class BinaryDsmReader
+{
+   public:
+      // Initialisation
+      BinaryDsmReader(const std::string& file_name, const uint64_t start = 0, const uint64_t end = bgzf_no_end);
+      ~BinaryDsmReader();
+
+      // nonmodifying operations
+      uint64_t num_kmers() const { return _header->num_kmers; }
+      int has_counts() const { return (_header->flags & binary_dsm_counts) != 0; }
+      const SampleIndex& samples() const { return _samples; }
+
+      // The current record, valid for the lifetime of the reader
+      const char* record() const { return _record; }
+      size_t record_length() const { return _record_length; }
+
+      std::string sequence() const; // this is defined in binaryDsmReader.cpp
+      void parse(Kmer& k, const SampleIndex& samples, std::vector<unsigned int>* counts = NULL, long int* dropped = NULL) const; // this is defined in binaryDsmReader.cpp
+
+      static int isBinaryDsm(const std::string& file_name); // this is defined in binaryDsmReader.cpp
+
+      // Modifying operations
+      bool next_record(); // this is defined in binaryDsmReader.cpp. Returns false at the end of the file or range
+
+   private:
+      BinaryDsmReader(const BinaryDsmReader&);
+      BinaryDsmReader& operator=(const BinaryDsmReader&);
+
+      void mapSamples(const SampleIndex& samples) const;
+      int validRecord(const uint64_t start, const uint64_t end) const;
+      void unreadable(const std::string& message);
+
+      int _fd;
+      const char* _data;
+      size_t _size;
+
+      const BinaryDsmHeader* _header;
+      const uint64_t* _index;
+      SampleIndex _samples;
+      size_t _presence_words;
+
+      uint64_t _next; // in _index
+      uint64_t _last;
+      const char* _record;
+      size_t _record_length;
+      uint64_t _records_offset; // after the sample names
+
+      // Index in the pheno samples of each sample in the file, for the last
+      // samples parsed against
+      mutable const SampleIndex* _mapped_samples;
+      mutable std::vector<int> _sample_map;
+      mutable int _same_samples;
+};
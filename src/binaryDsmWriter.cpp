@@ -0,0 +1,145 @@
+/*
+ * File: binaryDsmWriter.cpp
+ *
+ * Writes binary dsm files
+ *
+ */
+
+#include "seercommon.hpp"
+
+#include <cstring>
+
+BinaryDsmWriter::BinaryDsmWriter(const std::string& file_name, const SampleIndex& samples, const int counts)
+   :_offset(0), _closed(0)
+{
+   _file.open(file_name.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+   if (!_file)
+   {
+      throw std::runtime_error("Could not open output file " + file_name + "\n");
+   }
+
+   // Number of k-mers and index offset are filled in by close()
+   memset(&_header, 0, sizeof(BinaryDsmHeader));
+   memcpy(_header.magic, binary_dsm_magic, sizeof(binary_dsm_magic));
+   _header.version = binary_dsm_version;
+   _header.flags = counts ? binary_dsm_counts : 0;
+   _header.num_samples = samples.size();
+
+   _file.write(reinterpret_cast<const char*>(&_header), sizeof(BinaryDsmHeader));
+   _offset = sizeof(BinaryDsmHeader);
+
+   for (size_t i = 0; i < samples.size(); ++i)
+   {
+      const std::string name = samples.name(i);
+      const uint32_t length = name.size();
+      _file.write(reinterpret_cast<const char*>(&length), sizeof(uint32_t));
+      _file.write(name.data(), length);
+      _offset += sizeof(uint32_t) + length;
+   }
+   pad(binaryDsmPadding(_offset));
+}
+
+BinaryDsmWriter::~BinaryDsmWriter()
+{
+   if (!_closed)
+   {
+      try
+      {
+         close();
+      }
+      catch (std::exception& e)
+      {
+         std::cerr << e.what();
+      }
+   }
+}
+
+// Packs the sequence four bases to a byte (or as text if not all ACGT),
+// followed by the presence row and any counts
+void BinaryDsmWriter::write(const std::string& sequence, const BitVector& presence, const std::vector<unsigned int>& counts)
+{
+   if (presence.size() != _header.num_samples)
+   {
+      throw std::runtime_error("k-mer " + sequence + " has presence for the wrong number of samples");
+   }
+
+   int packable = sequence.find_first_not_of("ACGT") == std::string::npos;
+   uint32_t length = sequence.size();
+
+   _record.assign(reinterpret_cast<const char*>(&length), sizeof(uint32_t));
+   if (packable)
+   {
+      std::string packed((sequence.size() + 3) / 4, 0);
+      for (size_t i = 0; i < sequence.size(); ++i)
+      {
+         unsigned char base = 0;
+         switch (sequence[i])
+         {
+            case 'C':
+               base = 1;
+               break;
+            case 'G':
+               base = 2;
+               break;
+            case 'T':
+               base = 3;
+               break;
+         }
+         packed[i >> 2] |= base << ((i & 3) << 1);
+      }
+      _record += packed;
+   }
+   else
+   {
+      length |= binary_dsm_text_sequence;
+      memcpy(&_record[0], &length, sizeof(uint32_t));
+      _record += sequence;
+   }
+   _record.append(binaryDsmPadding(_record.size()), 0);
+
+   _record.append(reinterpret_cast<const char*>(presence.words()), presence.num_words() * sizeof(uint64_t));
+
+   if (_header.flags & binary_dsm_counts)
+   {
+      presence.for_each_set([&](const size_t i)
+      {
+         const uint32_t count = i < counts.size() ? counts[i] : 1;
+         _record.append(reinterpret_cast<const char*>(&count), sizeof(uint32_t));
+      });
+   }
+
+   write_record(_record.data(), _record.size());
+}
+
+void BinaryDsmWriter::write_record(const char* record, const size_t length)
+{
+   _index.push_back(_offset);
+   _file.write(record, length);
+   _offset += length;
+   pad(binaryDsmPadding(_offset));
+}
+
+// Writes the index, then goes back to complete the header
+void BinaryDsmWriter::close()
+{
+   _header.num_kmers = _index.size();
+   _header.index_offset = _offset;
+   _file.write(reinterpret_cast<const char*>(_index.data()), _index.size() * sizeof(uint64_t));
+
+   _file.seekp(0);
+   _file.write(reinterpret_cast<const char*>(&_header), sizeof(BinaryDsmHeader));
+   _file.close();
+   _closed = 1;
+
+   if (!_file)
+   {
+      throw std::runtime_error("Error writing binary kmer file\n");
+   }
+}
+
+void BinaryDsmWriter::pad(const size_t length)
+{
+   const char zeros[binary_dsm_alignment] = {0};
+   _file.write(zeros, length);
+   _offset += length;
+}
@@ -0,0 +1,40 @@
+/*
+ * binaryDsmWriter.hpp
+ * Header file for binaryDsmWriter class
+ */
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Writes a binary dsm file (see binaryDsm.hpp). Presence rows are against
+// the given samples. The index and completed header are written by close(),
+// which the destructor calls if need be
+class BinaryDsmWriter
+{
+   public:
+      // Initialisation
+      BinaryDsmWriter(const std::string& file_name, const SampleIndex& samples, const int counts = 0);
+      ~BinaryDsmWriter();
+
+      // Modifying operations
+      // counts are by sample, and only written if the file has counts
+      void write(const std::string& sequence, const BitVector& presence, const std::vector<unsigned int>& counts); // this is defined in binaryDsmWriter.cpp
+      // A record from a BinaryDsmReader with the same samples
+      void write_record(const char* record, const size_t length); // this is defined in binaryDsmWriter.cpp
+      void close(); // this is defined in binaryDsmWriter.cpp
+
+   private:
+      BinaryDsmWriter(const BinaryDsmWriter&);
+      BinaryDsmWriter& operator=(const BinaryDsmWriter&);
+
+      void pad(const size_t length);
+
+      std::ofstream _file;
+      BinaryDsmHeader _header;
+      std::vector<uint64_t> _index;
+      uint64_t _offset;
+      int _closed;
+
+      std::string _record; // reused between k-mers
+};
@@ -0,0 +1,43 @@
+/*
+ * File: bitMatrix.cpp
+ *
+ * Helper functions for the bitMatrix class
+ *
+ */
+
+#include "bitvector.hpp"
+#include "bitMatrix.hpp"
+
+BitMatrix::BitMatrix()
+   :_num_rows(0), _num_cols(0), _row_words(0)
+{
+}
+
+BitMatrix::BitMatrix(const size_t num_rows, const size_t num_cols)
+   :_words(num_rows * ((num_cols + 63) / 64), 0), _num_rows(num_rows), _num_cols(num_cols), _row_words((num_cols + 63) / 64)
+{
+}
+
+// Overwrites column j, setting the bit of each row from the column
+void BitMatrix::set_col(const size_t j, const BitVector& column)
+{
+   const size_t word = j >> 6;
+   const uint64_t mask = (uint64_t)1 << (j & 63);
+   for (size_t i = 0; i < _num_rows; ++i)
+   {
+      uint64_t& row_word = _words[i * _row_words + word];
+      row_word = column.test(i) ? (row_word | mask) : (row_word & ~mask);
+   }
+}
+
+// Overwrites column j with column from_j of another matrix
+void BitMatrix::copy_col(const size_t j, const BitMatrix& from, const size_t from_j)
+{
+   const size_t word = j >> 6;
+   const uint64_t mask = (uint64_t)1 << (j & 63);
+   for (size_t i = 0; i < _num_rows; ++i)
+   {
+      uint64_t& row_word = _words[i * _row_words + word];
+      row_word = from.test(i, from_j) ? (row_word | mask) : (row_word & ~mask);
+   }
+}
@@ -0,0 +1,36 @@
+/*
+ * bitMatrix.hpp
+ * Header file for bitMatrix class
+ */
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// A matrix of bits, with each row packed 64 to a word. kmds keeps its
+// subsample of k-mers as one row per sample and a column per k-mer, so the
+// distance between two samples is a popcount over their rows
+class BitMatrix
+{
+   public:
+      // Initialisation
+      BitMatrix();
+      BitMatrix(const size_t num_rows, const size_t num_cols); // all bits unset
+
+      // nonmodifying operations
+      size_t n_rows() const { return _num_rows; }
+      size_t n_cols() const { return _num_cols; }
+      size_t row_words() const { return _row_words; }
+      const uint64_t* row(const size_t i) const { return _words.data() + i * _row_words; }
+      bool test(const size_t i, const size_t j) const { return (row(i)[j >> 6] >> (j & 63)) & 1; }
+
+      // Modifying operations
+      void set_col(const size_t j, const BitVector& column); // this is defined in bitMatrix.cpp. column has a bit per row
+      void copy_col(const size_t j, const BitMatrix& from, const size_t from_j); // this is defined in bitMatrix.cpp. from has the same rows
+
+   private:
+      std::vector<uint64_t> _words;
+      size_t _num_rows;
+      size_t _num_cols;
+      size_t _row_words;
+};
@@ -0,0 +1,52 @@
+/*
+ * File: bitvector.cpp
+ *
+ * Helper functions for the bitvector class
+ *
+ */
+
+#include "bitvector.hpp"
+#include "popcount.hpp"
+
+BitVector::BitVector()
+   :_num_bits(0)
+{
+}
+
+BitVector::BitVector(const size_t num_bits)
+   :_words((num_bits + 63) / 64, 0), _num_bits(num_bits)
+{
+}
+
+BitVector::BitVector(const size_t num_bits, const uint64_t* words)
+   :_words(words, words + (num_bits + 63) / 64), _num_bits(num_bits)
+{
+}
+
+// Number of set bits
+size_t BitVector::count() const
+{
+   return popcount(_words.data(), _words.size());
+}
+
+// Number of bits set in both this and other, which must be the same size
+size_t BitVector::count_and(const BitVector& other) const
+{
+   return popcountAnd(_words.data(), other.words(), _words.size());
+}
+
+// Hash of the set bits. Each word is mixed with the splitmix64 finaliser
+// before being combined, so similar patterns land in different buckets
+size_t BitVector::hash() const
+{
+   uint64_t h = _num_bits;
+   for (auto it = _words.begin(); it != _words.end(); ++it)
+   {
+      uint64_t z = *it + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+      h ^= z ^ (z >> 31);
+   }
+
+   return h;
+}
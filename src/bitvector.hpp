@@ -0,0 +1,57 @@
+/*
+ * bitvector.hpp
+ * Header file for bitvector class
+ */
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// A fixed length set of bits, packed 64 to a word. Used to store which
+// samples a k-mer is present in
+class BitVector
+{
+   public:
+      // Initialisation
+      BitVector();
+      BitVector(const size_t num_bits); // all bits unset
+      BitVector(const size_t num_bits, const uint64_t* words); // copies (num_bits + 63) / 64 words
+
+      // nonmodifying operations
+      size_t size() const { return _num_bits; }
+      size_t num_words() const { return _words.size(); }
+      const uint64_t* words() const { return _words.data(); }
+      bool test(const size_t i) const { return (_words[i >> 6] >> (i & 63)) & 1; }
+      size_t count() const; // this is defined in bitvector.cpp
+      size_t count_and(const BitVector& other) const; // this is defined in bitvector.cpp
+      size_t hash() const; // this is defined in bitvector.cpp
+      bool operator==(const BitVector& other) const { return _num_bits == other._num_bits && _words == other._words; }
+
+      // Calls f(i) for the index of each set bit, in increasing order
+      template <class F>
+      void for_each_set(F f) const
+      {
+         for (size_t w = 0; w < _words.size(); ++w)
+         {
+            uint64_t word = _words[w];
+            while (word)
+            {
+               f((w << 6) + __builtin_ctzll(word));
+               word &= word - 1;
+            }
+         }
+      }
+
+      // Modifying operations
+      void set(const size_t i) { _words[i >> 6] |= (uint64_t)1 << (i & 63); }
+
+   private:
+      std::vector<uint64_t> _words;
+      size_t _num_bits;
+};
+
+// For use as a key in hash tables
+struct BitVectorHash
+{
+   size_t operator()(const BitVector& bits) const { return bits.hash(); }
+};
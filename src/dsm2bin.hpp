@@ -0,0 +1,14 @@
+/*
+ *
+ * dsm2bin.hpp
+ * Header file for dsm2bin
+ *
+ */
+
+// Common headers
+#include "seercommon.hpp"
+
+// Function headers
+// dsm2binCmdLine.cpp
+int parseCommandLine (int argc, char *argv[], boost::program_options::variables_map& vm);
+void printHelp(boost::program_options::options_description& help);
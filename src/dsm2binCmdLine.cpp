@@ -0,0 +1,82 @@
+/*
+ * File: dsm2binCmdLine.cpp
+ *
+ * Reads command line input to dsm2bin
+ *
+ */
+
+#include "dsm2bin.hpp"
+
+namespace po = boost::program_options; // Save some typing
+
+// Use boost::program_options to parse command line input
+// This does pretty much all the parameter checking needed
+int parseCommandLine (int argc, char *argv[], po::variables_map& vm)
+{
+   int failed = 0;
+
+   //Required options
+   po::options_description required("Required options");
+   required.add_options()
+    ("kmers,k", po::value<std::string>()->required(), "dsm kmer file to convert")
+    ("pheno,p", po::value<std::string>()->required(), ".pheno metadata. Only these samples are kept")
+    ("output,o", po::value<std::string>()->required(), "binary kmer file to write");
+
+   po::options_description other("Other options");
+   other.add_options()
+    ("counts", "keep the count of each kmer in each sample")
+    ("threads", po::value<int>()->default_value(1), "number of threads to decompress bgzipped input with")
+    ("version", "prints version and exits")
+    ("help,h", "full help message");
+
+   po::options_description all;
+   all.add(required).add(other);
+
+   try
+   {
+      po::store(po::command_line_parser(argc, argv).options(all).run(), vm);
+
+      if (vm.count("help"))
+      {
+         printHelp(all);
+         failed = 1;
+      }
+      else if (vm.count("version"))
+      {
+         std::cout << VERSION << std::endl;
+         failed = 1;
+      }
+      else
+      {
+         po::notify(vm);
+         failed = 0;
+
+         // Check input files exist, and can stat
+         if (!fileStat(vm["kmers"].as<std::string>()) || !fileStat(vm["pheno"].as<std::string>()))
+         {
+            failed = 1;
+         }
+      }
+
+   }
+   catch (po::error& e)
+   {
+      // Report errors from boost library
+      std::cerr << "Error in command line input: " << e.what() << "\n";
+      std::cerr << "Run 'dsm2bin --help' for full option listing\n\n";
+      std::cerr << required << "\n" << other << "\n";
+
+      failed = 1;
+   }
+
+   return failed;
+}
+
+// Print long help message
+void printHelp(po::options_description& help)
+{
+   std::cerr << "dsm2bin" << "\n";
+   std::cerr << "\tconverts a dsm kmer file to a binary file, which seer and kmds take as -k\n";
+
+   std::cerr << help << "\n";
+}
@@ -0,0 +1,65 @@
+/*
+ * File: dsm2binMain.cpp
+ *
+ * Converts dsm files to the binary format, which seer and kmds read
+ * without parsing
+ *
+ */
+
+#include "dsm2bin.hpp"
+
+int main (int argc, char *argv[])
+{
+   // Program description
+   std::cerr << "dsm2bin: convert k-mer files to binary\n";
+
+   // Do parsing and checking of command line params
+   // If no input options, give quick usage rather than full help
+   boost::program_options::variables_map vm;
+   if (argc == 1)
+   {
+      std::cerr << "Usage: dsm2bin -k dsm.txt.gz -p data.pheno -o dsm.bin\n\n"
+         << "For full option details run dsm2bin -h\n";
+      return 0;
+   }
+   else if (parseCommandLine(argc, argv, vm))
+   {
+      return 1;
+   }
+
+   // Presence rows are against the samples in the pheno file
+   std::vector<Sample> samples;
+   readPheno(vm["pheno"].as<std::string>(), samples);
+   const SampleIndex sample_index(samples);
+
+   unsigned int num_threads = 1;
+   if (vm["threads"].as<int>() > 0)
+   {
+      num_threads = vm["threads"].as<int>();
+   }
+
+   const int write_counts = vm.count("counts") > 0;
+
+   DsmReader kmer_file(vm["kmers"].as<std::string>(), num_threads);
+   BinaryDsmWriter binary_file(vm["output"].as<std::string>(), sample_index, write_counts);
+
+   // Only samples in the pheno file are kept, so count what is lost
+   long int converted = 0, dropped = 0;
+   Kmer k;
+   std::vector<unsigned int> counts;
+   while (kmer_file.next_line())
+   {
+      kmer_file.parse(k, sample_index, write_counts ? &counts : NULL, &dropped);
+      binary_file.write(k.sequence(), k.presence(), counts);
+      converted++;
+   }
+   binary_file.close();
+
+   std::cerr << "Converted " << converted << " k-mers in " << samples.size() << " samples\n";
+   if (dropped > 0)
+   {
+      std::cerr << "WARNING: Dropped " << dropped << " occurrences in samples not in "
+         << vm["pheno"].as<std::string>() << ". Convert with the same -p file seer and kmds will use\n";
+   }
+   std::cerr << "Done.\n";
+}
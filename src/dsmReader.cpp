@@ -0,0 +1,267 @@
+/*
+ * File: dsmReader.cpp
+ *
+ * Reads dsm files, memory mapping them when uncompressed
+ * and inflating them in parallel when BGZF compressed
+ *
+ */
+
+#include "seercommon.hpp"
+
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+DsmReader::DsmReader(const std::string& file_name, const unsigned int threads, const uint64_t start, const uint64_t end)
+   :_mapped(0), _fd(-1), _data(NULL), _size(0), _pos(0), _line(NULL), _line_length(0)
+{
+   // The format is found from the first bytes of the file, which are only
+   // read from regular files. Anything else, such as a pipe, is streamed
+   // through igzstream, which reads both gzipped and uncompressed text
+   const int binary = BinaryDsmReader::isBinaryDsm(file_name);
+   const int bgzf = !binary && BgzfReader::isBgzf(file_name);
+   if (!binary && !bgzf && (start != 0 || end != bgzf_no_end))
+   {
+      throw std::runtime_error("--region needs a BGZF compressed (use bgzip) or binary (use dsm2bin) kmer file. " + file_name + " is neither\n");
+   }
+
+   if (binary)
+   {
+      _binary.reset(new BinaryDsmReader(file_name, start, end));
+   }
+   else if (bgzf)
+   {
+      _bgzf.reset(new BgzfReader(file_name, threads, start, end));
+   }
+   else if (!regularFile(file_name) || gzippedFile(file_name))
+   {
+      openDsmFile(_gz_stream, file_name);
+   }
+   else
+   {
+      _fd = open(file_name.c_str(), O_RDONLY);
+      struct stat file_info;
+      if (_fd == -1 || fstat(_fd, &file_info) != 0 || !S_ISREG(file_info.st_mode))
+      {
+         if (_fd != -1)
+         {
+            close(_fd);
+         }
+         throw std::runtime_error("Could not open kmer file " + file_name + "\n");
+      }
+
+      _size = file_info.st_size;
+      if (_size > 0)
+      {
+         void* mapping = mmap(NULL, _size, PROT_READ, MAP_PRIVATE, _fd, 0);
+         if (mapping == MAP_FAILED)
+         {
+            close(_fd);
+            throw std::runtime_error("Could not map kmer file " + file_name + "\n");
+         }
+
+         // Read once, front to back
+         madvise(mapping, _size, MADV_SEQUENTIAL);
+         _data = static_cast<const char*>(mapping);
+      }
+      _mapped = 1;
+   }
+}
+
+DsmReader::~DsmReader()
+{
+   if (_mapped)
+   {
+      if (_data != NULL)
+      {
+         munmap(const_cast<char*>(_data), _size);
+      }
+      close(_fd);
+   }
+}
+
+// Only BGZF and binary files can be split, so other files are a single shard.
+// BGZF files are split by compressed bytes, which are shifted to virtual
+// offsets; the reader moves these forward to the next block
+std::vector<std::pair<uint64_t, uint64_t>> DsmReader::shards(const std::string& file_name, const unsigned int max_shards, const uint64_t start, const uint64_t end)
+{
+   std::vector<std::pair<uint64_t, uint64_t>> ranges;
+
+   const int binary = BinaryDsmReader::isBinaryDsm(file_name);
+   const int bgzf = !binary && BgzfReader::isBgzf(file_name);
+   struct stat file_info;
+   if ((binary || bgzf) && max_shards > 1 && stat(file_name.c_str(), &file_info) == 0)
+   {
+      const int shift = bgzf ? 16 : 0;
+      const uint64_t first = start >> shift;
+      const uint64_t last = std::min((uint64_t)file_info.st_size, end == bgzf_no_end ? bgzf_no_end : end >> shift);
+      const uint64_t num_shards = last > first ? std::min((uint64_t)max_shards, last - first) : 1;
+
+      uint64_t shard_start = start;
+      for (uint64_t shard = 1; shard < num_shards; ++shard)
+      {
+         const uint64_t shard_end = (first + shard * (last - first) / num_shards) << shift;
+         ranges.push_back(std::make_pair(shard_start, shard_end));
+         shard_start = shard_end;
+      }
+      ranges.push_back(std::make_pair(shard_start, end));
+   }
+   else
+   {
+      ranges.push_back(std::make_pair(start, end));
+   }
+
+   return ranges;
+}
+
+bool DsmReader::next_line()
+{
+   bool read = false;
+   if (_mapped)
+   {
+      if (_pos < _size)
+      {
+         _line = _data + _pos;
+         const char* line_end = static_cast<const char*>(memchr(_line, '\n', _size - _pos));
+         if (line_end == NULL)
+         {
+            line_end = _data + _size;
+         }
+
+         _line_length = line_end - _line;
+         _pos += _line_length + 1;
+         read = true;
+      }
+   }
+   else if (_binary)
+   {
+      read = _binary->next_record();
+      if (read)
+      {
+         _line = _binary->record();
+         _line_length = _binary->record_length();
+      }
+   }
+   else if (_bgzf)
+   {
+      read = _bgzf->next_line(_line, _line_length);
+   }
+   else if (std::getline(_gz_stream, _buffer))
+   {
+      _line = _buffer.data();
+      _line_length = _buffer.size();
+      read = true;
+   }
+
+   return read;
+}
+
+/*
+ * Parses the current line into a k-mer, setting presence for the samples
+ * in the pheno file. Fields are found in place, and only the sequence is
+ * copied. Counts are only parsed if asked for
+ *
+ * Example dsm file line AAAAAAAAAAAAAAAAAATGCATATTTATCTTAG 5.172314 0.175087 100 0 100
+ * 0.164875 100 | 6925_3#7:9 6823_4#17:26 6871_2#9:8
+ *
+ * OR
+ *
+ * AAAAAAAAAAAAAAAAAATGCATATTTATCTTAG 5.172314 6925_3#7:9 6823_4#17:26 6871_2#9:8
+ *
+ */
+void DsmReader::parse(Kmer& k, const SampleIndex& samples, std::vector<unsigned int>* counts, long int* dropped) const
+{
+   if (_binary)
+   {
+      _binary->parse(k, samples, counts, dropped);
+   }
+   else
+   {
+      parseLine(k, samples, counts, dropped);
+   }
+}
+
+void DsmReader::parseLine(Kmer& k, const SampleIndex& samples, std::vector<unsigned int>* counts, long int* dropped) const
+{
+   if (counts != NULL)
+   {
+      counts->assign(samples.size(), 0);
+   }
+
+   const char* pos = _line;
+   const char* end = _line + _line_length;
+
+   BitVector presence(samples.size());
+   std::string sequence;
+
+   int field = 0, in_samples = 0;
+   while (pos < end)
+   {
+      // Fields are separated by spaces (or tabs)
+      while (pos < end && (*pos == ' ' || *pos == '\t' || *pos == '\r'))
+      {
+         ++pos;
+      }
+      const char* field_start = pos;
+      while (pos < end && *pos != ' ' && *pos != '\t' && *pos != '\r')
+      {
+         ++pos;
+      }
+      const size_t field_length = pos - field_start;
+      if (field_length == 0)
+      {
+         break;
+      }
+
+      // First field is the kmer
+      if (field++ == 0)
+      {
+         sequence.assign(field_start, field_length);
+         continue;
+      }
+
+      // Entropy fields end with a | separator, or otherwise the first field
+      // with a : is the first sample
+      const char* colon = static_cast<const char*>(memchr(field_start, ':', field_length));
+      if (!in_samples)
+      {
+         if (field_length == 1 && *field_start == '|')
+         {
+            in_samples = 1;
+            continue;
+         }
+         else if (colon != NULL)
+         {
+            in_samples = 1;
+         }
+      }
+
+      // Samples are name:count
+      if (in_samples && colon != NULL)
+      {
+         int sample_index = samples.find(field_start, colon - field_start);
+         if (sample_index >= 0)
+         {
+            presence.set(sample_index);
+            if (counts != NULL)
+            {
+               // Lines are not null terminated, so no strtoul
+               unsigned int count = 0;
+               for (const char* digit = colon + 1; digit < pos && *digit >= '0' && *digit <= '9'; ++digit)
+               {
+                  count = count * 10 + (*digit - '0');
+               }
+               (*counts)[sample_index] = count;
+            }
+         }
+         else if (dropped != NULL)
+         {
+            (*dropped)++;
+         }
+      }
+   }
+
+   k = Kmer(sequence, kmer_occ_default);
+   k.add_x(presence);
+}
@@ -0,0 +1,69 @@
+/*
+ * dsmReader.hpp
+ * Header file for dsmReader class
+ */
+
+#include <string>
+#include <memory>
+#include <vector>
+#include <utility>
+#include <gzstream.h>
+
+// Reads dsm files line by line. Uncompressed files are memory mapped and
+// lines are parsed where they lie; BGZF files are inflated over the given
+// number of threads, and other gzipped files and pipes are read through
+// igzstream. Binary dsm files from dsm2bin are read a record at a time
+// instead. The format is found from the first bytes, not the file name
+//
+// Only BGZF and binary files can be read in a range, given as virtual
+// offsets (see bgzfReader.hpp) or byte offsets respectively. These can also
+// be split into shards, to be read in parallel
+class DsmReader
+{
+   public:
+      // Initialisation
+      DsmReader(const std::string& file_name, const unsigned int threads = 1,
+            const uint64_t start = 0, const uint64_t end = bgzf_no_end);
+      ~DsmReader();
+
+      // nonmodifying operations
+      // The current line, without its newline (or record for binary files).
+      // Valid until the next call to next_line()
+      const char* line() const { return _line; }
+      size_t line_length() const { return _line_length; }
+      int mapped() const { return _mapped; }
+      const BinaryDsmReader* binary() const { return _binary.get(); } // NULL unless a binary file
+
+      // Splits the range start to end into up to max_shards consecutive
+      // ranges, which between them read the same lines
+      static std::vector<std::pair<uint64_t, uint64_t>> shards(const std::string& file_name, const unsigned int max_shards,
+            const uint64_t start = 0, const uint64_t end = bgzf_no_end); // this is defined in dsmReader.cpp
+
+      // Modifying operations
+      bool next_line(); // this is defined in dsmReader.cpp. Returns false at the end of the file
+      // If counts is given it is set to the count in each sample. If dropped
+      // is given, occurrences in samples not in the pheno file are added to it
+      void parse(Kmer& k, const SampleIndex& samples, std::vector<unsigned int>* counts = NULL, long int* dropped = NULL) const; // this is defined in dsmReader.cpp
+
+   private:
+      DsmReader(const DsmReader&);
+      DsmReader& operator=(const DsmReader&);
+
+      void parseLine(Kmer& k, const SampleIndex& samples, std::vector<unsigned int>* counts, long int* dropped) const;
+
+      // Memory mapped input
+      int _mapped;
+      int _fd;
+      const char* _data;
+      size_t _size;
+      size_t _pos;
+
+      // Compressed input
+      std::unique_ptr<BgzfReader> _bgzf;
+      std::unique_ptr<BinaryDsmReader> _binary;
+      igzstream _gz_stream;
+      std::string _buffer;
+
+      const char* _line;
+      size_t _line_length;
+};
@@ -30,6 +30,7 @@ int parseCommandLine (int argc, char *argv[], po::variables_map& vm)
    po::options_description other("Other options");
    other.add_options()
     ("sort,s", po::value<std::string>(), "field to sort on: chisq, pval, maf or beta")
+    ("threads", po::value<int>()->default_value(1), "number of threads to decompress bgzipped input with")
     ("version", "prints version and exits")
     ("help,h", "full help message");
 
@@ -144,6 +145,15 @@ cmdOptions processCmdLine(po::variables_map& vm)
       processed_options.sort_field = "";
    }
 
+   if (vm.count("threads") && vm["threads"].as<int>() > 0)
+   {
+      processed_options.threads = vm["threads"].as<int>();
+   }
+   else
+   {
+      processed_options.threads = 1;
+   }
+
    return processed_options;
 }
 
@@ -45,8 +45,19 @@ int main (int argc, char *argv[])
    // Open input file, check opened ok
    try
    {
-      std::ifstream kmers_in(options.input_file.c_str());
-      if (!kmers_in)
+      // bgzipped input is inflated over the threads
+      std::ifstream kmers_in;
+      std::unique_ptr<BgzfReader> bgzf_in;
+      if (BgzfReader::isBgzf(options.input_file))
+      {
+         bgzf_in.reset(new BgzfReader(options.input_file, options.threads));
+      }
+      else
+      {
+         kmers_in.open(options.input_file.c_str());
+      }
+
+      if (!bgzf_in && !kmers_in)
       {
          throw std::runtime_error("Could not open input file " + options.input_file);
       }
@@ -54,16 +65,18 @@ int main (int argc, char *argv[])
       {
          // Read the header
          std::string header;
-         std::getline(kmers_in, header);
+         nextLine(kmers_in, bgzf_in.get(), header);
          int num_covar_fields = parseHeader(header);
 
-         while (kmers_in)
+         std::string line;
+         while (nextLine(kmers_in, bgzf_in.get(), line))
          {
             // Read in each kmer
+            std::istringstream line_in(line);
             Significant_kmer kmer(num_covar_fields);
-            kmers_in >> kmer;
+            line_in >> kmer;
 
-            if (kmers_in)
+            if (line_in)
             {
                // Filter fields. MAF needs to include max, beta needs modulus
                if (options.maf_filter && (kmer.maf() < options.maf_filter || 1-kmer.maf() < options.maf_filter))
@@ -151,3 +164,26 @@ int main (int argc, char *argv[])
    return(0);
 }
 
+
+// Reads the next line from the BGZF reader if there is one, or otherwise the
+// stream
+bool nextLine(std::istream& is, BgzfReader* bgzf, std::string& line)
+{
+   bool read = false;
+   if (bgzf != NULL)
+   {
+      const char* line_start;
+      size_t line_length;
+      read = bgzf->next_line(line_start, line_length);
+      if (read)
+      {
+         line.assign(line_start, line_length);
+      }
+   }
+   else
+   {
+      read = static_cast<bool>(std::getline(is, line));
+   }
+
+   return read;
+}
@@ -10,6 +10,8 @@
 #include <algorithm>
 #include <list>
 #include <iterator>
+#include <sstream>
+#include <memory>
 #include <stdexcept>
 #include <math.h>
 
@@ -17,6 +19,7 @@
 #include <boost/program_options.hpp>
 
 #include "significant_kmer.hpp"
+#include "bgzfReader.hpp"
 
 // Constants
 const std::string VERSION = "1.1.2";
@@ -27,11 +30,13 @@ struct cmdOptions
    std::string input_file, output_file, sort_field;
    double maf_filter, chi_filter, p_filter, beta_filter;
    bool neg_beta, substr_kmers;
+   unsigned int threads;
 };
 
 // Function prototypes
 int parseCommandLine (int argc, char *argv[], boost::program_options::variables_map& vm);
 cmdOptions processCmdLine(boost::program_options::variables_map& vm);
 double fractionFilter(const std::string& filter_input);
+bool nextLine(std::istream& is, BgzfReader* bgzf, std::string& line);
 void printHelp(boost::program_options::options_description& help);
 
@@ -12,18 +12,43 @@
 #include <random>
 #include <queue>
 #include <future>
+#include <atomic>
+#include <functional>
+#include <sstream>
+
+// Packed bit kernels, for distances between samples
+#include "popcount.hpp"
 
 // Constants
 //    Default options
 const int pc_default = 10;
 const long int size_default = 1000000;
+const unsigned int seed_default = 1;
+
+// Distances are calculated in tiles of this many samples square, and packed
+// rows this many words at a time. Progress is reported for matrices of at
+// least distance_progress_tiles tiles
+const size_t distance_tile_rows = 16;
+const size_t hamming_chunk_words = 512;
+const size_t distance_progress_tiles = 1000;
+
+// MDS finds the top eigenvalues by subspace iteration on this many extra
+// vectors, to this tolerance relative to the largest eigenvalue. Up to
+// mds_dense_samples samples all eigenvalues are calculated instead
+const size_t mds_dense_samples = 1000;
+const int mds_oversample = 10;
+const unsigned int mds_max_iterations = 200;
+const double mds_tolerance = 1e-5;
+const unsigned int mds_seed = 1;
 
 // Structs
-struct DistanceElement
+// A uniform sample of up to size k-mers from those seen in one shard of the
+// k-mer file, as a column per k-mer
+struct KmerReservoir
 {
-   unsigned int row;
-   unsigned int col;
-   double distance;
+   BitMatrix kmers;
+   long int sampled;
+   long int seen;
 };
 
 // kmdsCmdLine headers
@@ -32,8 +57,22 @@ void printHelp(boost::program_options::options_description& help);
 
 // kmdsStruct headers
 arma::mat metricMDS(const arma::mat& populationMatrix, const int dimensions, const unsigned int threads, const std::string& distances_file = "");
+arma::mat metricMDS(const BitMatrix& populationMatrix, const size_t num_kmers, const int dimensions, const unsigned int threads, const std::string& distances_file = "");
+arma::mat mdsFromDistances(arma::mat distances, const int dimensions, const unsigned int threads, const std::string& distances_file = "");
+void doubleCentre(arma::mat& P);
+void topEigenpairs(const arma::mat& B, const int k, const unsigned int threads, arma::vec& eigval, arma::mat& eigvec);
+arma::mat symmetricProduct(const arma::mat& B, const arma::mat& Q, const unsigned int threads);
 arma::mat dissimiliarityMatrix(const arma::mat& inMat, const unsigned int threads);
+arma::mat gramDistances(const arma::mat& inMat, const unsigned int threads);
+arma::mat pairwiseDistances(const arma::mat& inMat, const unsigned int threads);
+arma::mat hammingDistances(const BitMatrix& bits, const unsigned int threads);
+void tiledTriangle(const size_t matSize, const unsigned int threads, const std::function<void(size_t, size_t)>& tile_function);
+void pairwiseTile(const arma::mat& inMat, const size_t first_row, const size_t first_col, arma::mat& dist);
+void hammingTile(const BitMatrix& bits, const size_t first_row, const size_t first_col, arma::mat& dist);
+arma::mat unpackMatrix(const BitMatrix& bits, const size_t num_cols);
 
-std::vector<DistanceElement> threadDistance(std::vector<DistanceElement> element_list, const arma::mat& rectangular_matrix);
-double distanceFunction(const arma::rowvec& vec_1, const arma::rowvec& vec_2);
-
+// kmdsSample headers
+KmerReservoir sampleShard(const cmdOptions& parameters, const SampleIndex& samples, const uint64_t start, const uint64_t end,
+      const unsigned int reader_threads, const std::string& filtered_file_name, const unsigned int shard);
+BitMatrix mergeReservoirs(std::vector<KmerReservoir>& reservoirs, const long int size, const unsigned int seed, long int& sampled);
+void mergeFiltered(const std::string& file_name, const std::vector<std::string>& shard_files, const int binary);
@@ -18,7 +18,7 @@ int parseCommandLine (int argc, char *argv[], po::variables_map& vm)
    //Required options
    po::options_description required("Required options");
    required.add_options()
-    ("kmers,k", po::value<std::string>(), "dsm kmer output file (not needed if using --mds_concat)")
+    ("kmers,k", po::value<std::string>(), "dsm kmer output file, or binary kmer file from dsm2bin (not needed if using --mds_concat)")
     ("pheno,p", po::value<std::string>(), ".pheno metadata");
 
    po::options_description mds("MDS options");
@@ -29,7 +29,8 @@ int parseCommandLine (int argc, char *argv[], po::variables_map& vm)
     ("mds_concat", po::value<std::string>(), "list of subsampled matrices to use in MDS. Performs only MDS; implies --no_filtering")
     ("pc", po::value<int>()->default_value(pc_default), "number of principal coordinates to output")
     ("size", po::value<long int>()->default_value(size_default), "number of kmers to use in MDS")
-    ("threads", po::value<int>()->default_value(1), ("number of threads. Suggested: " + std::to_string(std::thread::hardware_concurrency())).c_str());
+    ("seed", po::value<unsigned int>()->default_value(seed_default), "random seed for subsampling kmers. The same seed, threads and input give the same subsample")
+    ("threads", po::value<int>()->default_value(1), ("number of threads, also used to read a bgzipped or binary kmer file in parallel shards. Suggested: " + std::to_string(std::thread::hardware_concurrency())).c_str());
 
    //Optional filtering parameters
    //NB pval cutoffs are strings for display, and are converted to floats later
@@ -38,7 +39,8 @@ int parseCommandLine (int argc, char *argv[], po::variables_map& vm)
     ("no_filtering", "turn off all filtering and do not output new kmer file")
     ("max_length", po::value<long int>()->default_value(max_length_default), "maximum kmer length")
     ("maf", po::value<double>()->default_value(maf_default), "minimum kmer frequency")
-    ("min_words", po::value<int>(), "minimum kmer occurrences. Overrides --maf");
+    ("min_words", po::value<int>(), "minimum kmer occurrences. Overrides --maf")
+    ("region", po::value<std::string>(), "only read k-mers in this range of a bgzipped k-mer file (start:end virtual offsets) or binary k-mer file (start:end byte offsets)");
 
    po::options_description other("Other options");
    other.add_options()
@@ -7,9 +7,6 @@
 
 #include "kmds.hpp"
 
-// globals
-std::default_random_engine rand_gen;
-
 // $1 file location, $2 file name, $3 file ending
 const std::regex file_format_e ("^(.+)\\/(.+)\\.([^\\.]+)$");
 const std::regex file_format_within_e ("^(.+)\\.([^\\.]+)$"); // When in same directory, but not with a ./ prefix
@@ -57,16 +54,16 @@ int main (int argc, char *argv[])
 
    // Open .pheno file, parse into vector of samples
    std::vector<Sample> samples;
-   std::unordered_map<std::string,int> sample_map;
 
    if (vm.count("pheno"))
    {
-      readPheno(vm["pheno"].as<std::string>(), samples, sample_map);
+      readPheno(vm["pheno"].as<std::string>(), samples);
    }
    else
    {
       throw std::runtime_error("--pheno option is compulsory");
    }
+   const SampleIndex sample_index(samples);
 
    arma::vec y = constructVecY(samples);
 
@@ -82,30 +79,25 @@ int main (int argc, char *argv[])
 
       cmdOptions parameters = verifyCommandLine(vm, samples);
 
-      // Open the dsm kmer ifstream, and read through the whole thing
-      igzstream kmer_file;
-      openDsmFile(kmer_file, parameters.kmers.c_str());
-
-      // Set up output files
-      ogzstream filtered_file;
+      // Set up output files. Binary input is filtered to a binary file
+      const int binary_input = BinaryDsmReader::isBinaryDsm(parameters.kmers);
+      const std::string filtered_suffix = binary_input ? ".bin" : ".gz";
       std::string output_file_name, dsm_file_name, distances_file_name;
       if (parameters.filter)
       {
          if (vm.count("output"))
          {
-            output_file_name = parameters.output + ".kmers.gz";
+            output_file_name = parameters.output + ".kmers" + filtered_suffix;
          }
          else
          {
-            output_file_name = std::regex_replace(parameters.kmers, file_format_e, std::string("$1/filtered.$2.gz"));
+            output_file_name = std::regex_replace(parameters.kmers, file_format_e, std::string("$1/filtered.$2") + filtered_suffix);
             if (output_file_name == parameters.kmers) // If first match fails
             {
-               output_file_name = std::regex_replace(parameters.kmers, file_format_within_e, std::string("filtered.$1.gz"));
+               output_file_name = std::regex_replace(parameters.kmers, file_format_within_e, std::string("filtered.$1") + filtered_suffix);
             }
 
          }
-
-         filtered_file.open(output_file_name.c_str());
       }
 
       if (vm.count("output"))
@@ -128,70 +120,45 @@ int main (int argc, char *argv[])
          }
       }
 
-      // vector of subsampled kmers
-      std::vector<arma::vec> dsm_kmers;
-      dsm_kmers.reserve(parameters.size);
+      // Read through the whole dsm kmer file. Where it can be, it is split
+      // into a shard per thread, each read, filtered and sampled in parallel
+      const std::vector<std::pair<uint64_t, uint64_t>> shards = DsmReader::shards(parameters.kmers,
+            parameters.num_threads, parameters.region_start, parameters.region_end);
+      const unsigned int reader_threads = shards.size() > 1 ? 1 : parameters.num_threads;
 
-      long int kmer_index = 0;
-      while (kmer_file)
+      std::vector<std::string> shard_files(shards.size(), output_file_name);
+      std::vector<std::future<KmerReservoir>> shard_samples;
+      for (unsigned int shard = 0; shard < shards.size(); ++shard)
       {
-         // Allow output of entire dsm line
-         std::string dsm_line;
-         std::getline(kmer_file, dsm_line);
-         std::stringstream dsm_stream(dsm_line);
-
-         Kmer k;
-         if (kmer_file)
+         if (shards.size() > 1)
          {
-            dsm_stream >> k;
-            k.add_x(sample_map, samples.size());
-
-            // apply filters here
-            int passed_filters = 0;
-            if (parameters.filter && passBasicFilters(parameters, k))
-            {
-               passed_filters = 1;
-               filtered_file << dsm_line << "\n";
-            }
-            else if (!parameters.filter)
-            {
-               passed_filters = 1;
-            }
-
-            // kmer has passed basic filters, so is a candidate for mds
-            // subsampling
-            if (passed_filters)
-            {
-               // Resevoir sampler for parameters.size kmers
-               kmer_index++;
-               if (dsm_kmers.size() < dsm_kmers.capacity())
-               {
-                  dsm_kmers.push_back(k.get_x());
-               }
-               else
-               {
-                  std::uniform_int_distribution<int> dist(0, kmer_index);
-                  int r = dist(rand_gen);
-                  if (r < parameters.size)
-                  {
-                     dsm_kmers[r] = k.get_x();
-                  }
-               }
-            }
+            shard_files[shard] = output_file_name + ".shard" + std::to_string(shard);
          }
+         shard_samples.push_back(std::async(std::launch::async, sampleShard, std::cref(parameters), std::cref(sample_index),
+                  shards[shard].first, shards[shard].second, reader_threads, shard_files[shard], shard));
       }
 
-      // Convert into arma::mat before MDS
-      arma::mat subsampledMatrix(samples.size(), dsm_kmers.size());
-      for (unsigned int i = 0; i < dsm_kmers.size(); ++i)
+      std::vector<KmerReservoir> reservoirs;
+      for (auto it = shard_samples.begin(); it != shard_samples.end(); ++it)
       {
-         subsampledMatrix.col(i) = dsm_kmers[i];
+         reservoirs.push_back(it->get());
       }
 
-      // Write output
+      if (parameters.filter && shards.size() > 1)
+      {
+         mergeFiltered(output_file_name, shard_files, binary_input);
+      }
+
+      // Subsampled kmers, packed as a row of bits for each sample
+      long int sampled_kmers = 0;
+      BitMatrix dsm_kmers = mergeReservoirs(reservoirs, parameters.size, parameters.seed, sampled_kmers);
+      reservoirs.clear();
+
+      // Write output. The subsampled matrix is written dense, as read by
+      // --mds_concat
       if (vm.count("no_mds"))
       {
-         writeMDS(dsm_file_name, samples, subsampledMatrix);
+         writeMDS(dsm_file_name, samples, unpackMatrix(dsm_kmers, sampled_kmers));
       }
       else
       {
@@ -199,11 +166,11 @@ int main (int argc, char *argv[])
          // Run metric MDS, then output to file
          if (parameters.write_distances)
          {
-            writeMDS(dsm_file_name, samples, metricMDS(subsampledMatrix, parameters.pc, parameters.num_threads, distances_file_name));
+            writeMDS(dsm_file_name, samples, metricMDS(dsm_kmers, sampled_kmers, parameters.pc, parameters.num_threads, distances_file_name));
          }
          else
          {
-            writeMDS(dsm_file_name, samples, metricMDS(subsampledMatrix, parameters.pc, parameters.num_threads));
+            writeMDS(dsm_file_name, samples, metricMDS(dsm_kmers, sampled_kmers, parameters.pc, parameters.num_threads));
          }
 
       }
@@ -0,0 +1,204 @@
+/*
+ * File: kmdsSample.cpp
+ *
+ * Filters and reservoir samples kmds k-mers, over
+ * shards of the k-mer file in parallel
+ *
+ */
+
+#include "kmds.hpp"
+
+#include <cstdio>
+#include <numeric>
+
+// Reads one range of the k-mer file. k-mers which pass the filters are
+// written to filtered_file_name, and sampled into a reservoir of
+// parameters.size k-mers (algorithm R)
+KmerReservoir sampleShard(const cmdOptions& parameters, const SampleIndex& samples, const uint64_t start, const uint64_t end,
+      const unsigned int reader_threads, const std::string& filtered_file_name, const unsigned int shard)
+{
+   DsmReader kmer_file(parameters.kmers, reader_threads, start, end);
+
+   // Binary input is filtered to a binary file
+   ogzstream filtered_file;
+   std::unique_ptr<BinaryDsmWriter> filtered_binary;
+   if (parameters.filter)
+   {
+      if (kmer_file.binary() != NULL)
+      {
+         filtered_binary.reset(new BinaryDsmWriter(filtered_file_name, kmer_file.binary()->samples(), kmer_file.binary()->has_counts()));
+      }
+      else
+      {
+         filtered_file.open(filtered_file_name.c_str());
+      }
+   }
+
+   // Each shard has its own generator, seeded from --seed and the shard
+   std::seed_seq shard_seed{parameters.seed, shard};
+   std::default_random_engine rand_gen(shard_seed);
+   std::uniform_int_distribution<long int> position;
+   typedef std::uniform_int_distribution<long int>::param_type positionRange;
+
+   KmerReservoir reservoir;
+   reservoir.kmers = BitMatrix(samples.size(), parameters.size);
+   reservoir.sampled = 0;
+   reservoir.seen = 0;
+
+   Kmer k;
+   while (kmer_file.next_line())
+   {
+      kmer_file.parse(k, samples);
+
+      // apply filters here, writing out the entire dsm line
+      int passed_filters = 0;
+      if (parameters.filter && passBasicFilters(parameters, k))
+      {
+         passed_filters = 1;
+         if (filtered_binary)
+         {
+            filtered_binary->write_record(kmer_file.line(), kmer_file.line_length());
+         }
+         else
+         {
+            filtered_file.write(kmer_file.line(), kmer_file.line_length());
+            filtered_file << "\n";
+         }
+      }
+      else if (!parameters.filter)
+      {
+         passed_filters = 1;
+      }
+
+      // kmer has passed basic filters, so is a candidate for mds
+      // subsampling. The i-th replaces a random sampled k-mer with probability
+      // size/i
+      if (passed_filters)
+      {
+         reservoir.seen++;
+         if (reservoir.sampled < parameters.size)
+         {
+            reservoir.kmers.set_col(reservoir.sampled++, k.presence());
+         }
+         else
+         {
+            const long int r = position(rand_gen, positionRange(0, reservoir.seen - 1));
+            if (r < parameters.size)
+            {
+               reservoir.kmers.set_col(r, k.presence());
+            }
+         }
+      }
+   }
+
+   return reservoir;
+}
+
+// Combines the reservoirs of each shard into one uniform sample of up to size
+// k-mers from all those seen. Each k-mer is drawn from a shard with
+// probability proportional to the number that shard saw which are not yet
+// drawn, then from that shard's reservoir at random. As each reservoir is a
+// uniform sample of its shard, this is the same as sampling from every k-mer
+// at once
+BitMatrix mergeReservoirs(std::vector<KmerReservoir>& reservoirs, const long int size, const unsigned int seed, long int& sampled)
+{
+   BitMatrix merged;
+   if (reservoirs.size() == 1)
+   {
+      merged = std::move(reservoirs[0].kmers);
+      sampled = reservoirs[0].sampled;
+   }
+   else
+   {
+      // Seeded differently to any shard
+      std::seed_seq merge_seed{seed, (unsigned int)reservoirs.size()};
+      std::default_random_engine rand_gen(merge_seed);
+      std::uniform_int_distribution<long int> position;
+      typedef std::uniform_int_distribution<long int>::param_type positionRange;
+
+      // Columns of each reservoir are shuffled as they are drawn, so the
+      // first drawn[s] have been used
+      long int remaining = 0;
+      std::vector<long int> undrawn(reservoirs.size());
+      std::vector<long int> drawn(reservoirs.size(), 0);
+      std::vector<std::vector<long int>> columns(reservoirs.size());
+      for (size_t s = 0; s < reservoirs.size(); ++s)
+      {
+         undrawn[s] = reservoirs[s].seen;
+         remaining += reservoirs[s].seen;
+
+         columns[s].resize(reservoirs[s].sampled);
+         std::iota(columns[s].begin(), columns[s].end(), 0);
+      }
+
+      sampled = std::min(size, remaining);
+      merged = BitMatrix(reservoirs[0].kmers.n_rows(), size);
+      for (long int col = 0; col < sampled; ++col)
+      {
+         long int r = position(rand_gen, positionRange(0, remaining - 1));
+         size_t s = 0;
+         while (r >= undrawn[s])
+         {
+            r -= undrawn[s++];
+         }
+
+         // A shard never has more drawn than it sampled: either it sampled
+         // every k-mer it saw, or size of them
+         const long int pick = position(rand_gen, positionRange(drawn[s], columns[s].size() - 1));
+         std::swap(columns[s][drawn[s]], columns[s][pick]);
+         merged.copy_col(col, reservoirs[s].kmers, columns[s][drawn[s]++]);
+
+         undrawn[s]--;
+         remaining--;
+      }
+   }
+
+   return merged;
+}
+
+// Joins the filtered k-mers written by each shard, in order, and removes the
+// shard files. Gzipped text is concatenated as consecutive gzip members,
+// while binary records are copied into a new file with one index
+void mergeFiltered(const std::string& file_name, const std::vector<std::string>& shard_files, const int binary)
+{
+   if (binary)
+   {
+      std::unique_ptr<BinaryDsmWriter> merged;
+      for (auto it = shard_files.begin(); it != shard_files.end(); ++it)
+      {
+         BinaryDsmReader shard(*it);
+         if (!merged)
+         {
+            merged.reset(new BinaryDsmWriter(file_name, shard.samples(), shard.has_counts()));
+         }
+
+         while (shard.next_record())
+         {
+            merged->write_record(shard.record(), shard.record_length());
+         }
+      }
+      merged->close();
+   }
+   else
+   {
+      std::ofstream merged(file_name.c_str(), std::ios::binary);
+      for (auto it = shard_files.begin(); it != shard_files.end(); ++it)
+      {
+         std::ifstream shard(it->c_str(), std::ios::binary);
+         if (shard.peek() != std::ifstream::traits_type::eof())
+         {
+            merged << shard.rdbuf();
+         }
+      }
+
+      if (!merged)
+      {
+         throw std::runtime_error("Could not write filtered kmers to " + file_name);
+      }
+   }
+
+   for (auto it = shard_files.begin(); it != shard_files.end(); ++it)
+   {
+      std::remove(it->c_str());
+   }
+}
@@ -8,6 +8,28 @@
 #include "kmds.hpp"
 
 arma::mat metricMDS(const arma::mat& populationMatrix, const int dimensions, const unsigned int threads, const std::string& distances_file)
+{
+   return mdsFromDistances(dissimiliarityMatrix(populationMatrix, threads), dimensions, threads, distances_file);
+}
+
+// As above, for k-mers packed as a row of bits per sample. Only the first
+// num_kmers columns are used
+arma::mat metricMDS(const BitMatrix& populationMatrix, const size_t num_kmers, const int dimensions, const unsigned int threads, const std::string& distances_file)
+{
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+   arma::mat dist = hammingDistances(populationMatrix, threads) / num_kmers;
+
+   std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+   std::chrono::duration<double> diff = std::chrono::duration_cast<std::chrono::duration<double>>(end - start);
+   std::cerr << "Distance matrix calculated in: " << diff.count() << " s\n";
+
+   return mdsFromDistances(std::move(dist), dimensions, threads, distances_file);
+}
+
+// Metric MDS on a matrix of distances between samples. The distances are
+// squared and centred in place, so are taken by value
+arma::mat mdsFromDistances(arma::mat distances, const int dimensions, const unsigned int threads, const std::string& distances_file)
 {
    /*
     * Metric MDS
@@ -15,14 +37,16 @@ arma::mat metricMDS(const arma::mat& populationMatrix, const int dimensions, con
     * 1) P^2 -> matrix with elements which are distances squared
     * 2) J = I - n^-1(II') - II' is a square matrix of ones
     * 3) B = -0.5JP^2J
-    * 4) Decompose B into eigenvalues
+    * 4) Decompose B into its largest eigenvalues
     * 5) MDS components = eigenvectors * eigenvalues
     * 6) Normalise components
     */
-   const unsigned int matSize = populationMatrix.n_rows;
+   const unsigned int matSize = distances.n_rows;
+   const int components = std::min(dimensions, (int)matSize);
 
    // Step 1)
-   arma::mat P = arma::square(dissimiliarityMatrix(populationMatrix, threads));
+   arma::mat& P = distances;
+   P = arma::square(P);
 
    // If supplied as an optional parameter, write distance matrix to file
    if (!distances_file.empty())
@@ -30,30 +54,30 @@ arma::mat metricMDS(const arma::mat& populationMatrix, const int dimensions, con
       writeDistances(distances_file, P);
    }
 
-   // Step 2)
-   arma::mat J = arma::eye<arma::mat>(matSize, matSize)
-      - 1/double(matSize)*arma::ones<arma::mat>(matSize, matSize);
-
-   // Step 3)
-   arma::mat B = -0.5 * J * P * J;
+   // Steps 2) and 3)
+   // J is never formed, B overwrites P
+   doubleCentre(P);
+   const arma::mat& B = P;
 
    // Step 4)
+   // Eigenvalues are returned largest first
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
    arma::vec eigval;
    arma::mat eigvec;
+   topEigenpairs(B, components, threads, eigval, eigvec);
 
-   if (!arma::eig_sym(eigval, eigvec, B))
-   {
-      throw std::runtime_error("Could not calculate eigenvalues of B matrix in metric MDS");
-   }
+   std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+   std::chrono::duration<double> diff = std::chrono::duration_cast<std::chrono::duration<double>>(end - start);
+   std::cerr << "Eigendecomposition calculated in: " << diff.count() << " s\n";
 
    // Step 5)
-   // Eigenvalues returned are sorted ascending, so want to reverse order
-   arma::mat mds = fliplr(eigvec * diagmat(sqrt(eigval)));
+   arma::mat mds = eigvec * diagmat(sqrt(eigval));
 
    // Step 6)
    // All values will lie in the interval [-1,1]
-   arma::mat norm_mds(matSize, dimensions);
-   for (int i = 0; i < dimensions; ++i)
+   arma::mat norm_mds(matSize, components);
+   for (int i = 0; i < components; ++i)
    {
       if (pow(max(mds.col(i)), 2) > pow(min(mds.col(i)), 2))
       {
@@ -68,74 +92,142 @@ arma::mat metricMDS(const arma::mat& populationMatrix, const int dimensions, con
    return norm_mds;
 }
 
-// Distance between all rows. 0/1 elements only
-arma::mat dissimiliarityMatrix(const arma::mat& inMat, const unsigned int threads)
+// B = -0.5JPJ in place, without forming J. Element by element this is
+// B_ij = -0.5(P_ij - r_i - r_j + m), where r are the row means (which are
+// also the column means, as P is symmetric) and m is the grand mean
+void doubleCentre(arma::mat& P)
 {
-   const unsigned int matSize = inMat.n_rows;
-   arma::mat dist = arma::zeros<arma::mat>(matSize, matSize);
-
-   // Time parallelisation
-   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+   const arma::vec row_means = arma::mean(P, 1);
+   const double grand_mean = arma::mean(row_means);
 
-   // Create queue for distance calculations
-   std::queue<std::future<std::vector<DistanceElement>>> distance_calculations;
+   P.each_col() -= row_means;
+   P.each_row() -= row_means.t();
+   P += grand_mean;
+   P *= -0.5;
+}
 
-   // Set up number of jobs per thread
-   const unsigned long int num_calculations = 0.5*matSize*(matSize - 1);
-   const unsigned long int calc_per_thread = (unsigned long int)num_calculations / threads;
-   const unsigned int num_big_threads = num_calculations % threads;
+// The largest (not largest magnitude) k eigenvalues of symmetric B, in
+// descending order, with their eigenvectors as columns.
+// Small matrices are fully decomposed. Otherwise uses randomised subspace
+// iteration with Rayleigh-Ritz extraction, which needs products of B with
+// only k + mds_oversample vectors each iteration. See Halko, Martinsson &
+// Tropp (2011) SIAM Review 53:217
+void topEigenpairs(const arma::mat& B, const int k, const unsigned int threads, arma::vec& eigval, arma::mat& eigvec)
+{
+   const size_t n = B.n_rows;
+   const size_t subspace = std::min(n, (size_t)(k + mds_oversample));
 
-   // Keep track of row and column outside of outer loop
-   unsigned int row = 0;
-   unsigned int col = 0;
-   for (unsigned int thread_idx = 0; thread_idx < threads; ++thread_idx) // Loop over threads
+   int converged = 0;
+   if (n > mds_dense_samples && subspace < n / 2)
    {
-      // First 'big' threads have an extra job
-      unsigned long int thread_jobs;
-      if (distance_calculations.size() < num_big_threads)
-      {
-         thread_jobs = calc_per_thread + 1;
-      }
-      else
+      // Fixed seed so the same distances always give the same components
+      std::mt19937 rand_gen(mds_seed);
+      std::normal_distribution<double> normal;
+
+      arma::mat start_vectors(n, subspace);
+      for (size_t i = 0; i < start_vectors.n_elem; ++i)
       {
-         thread_jobs = calc_per_thread;
+         start_vectors(i) = normal(rand_gen);
       }
 
-      // Each thread is assigned elements to calculated scanning left to right,
-      // top to bottom on the upper triangle of the matrix
-      std::vector<DistanceElement> thread_elements;
-      thread_elements.reserve(thread_jobs);
-      for (unsigned int element = 0; element < calc_per_thread; ++element)
+      arma::mat Q, R;
+      arma::qr_econ(Q, R, start_vectors);
+
+      for (unsigned int iteration = 0; iteration < mds_max_iterations; ++iteration)
       {
-         DistanceElement d;
-         d.row = row;
-         d.col = ++col;
+         const arma::mat BQ = symmetricProduct(B, Q, threads);
+
+         // Ritz values in ascending order, so the top k are the last columns
+         arma::vec ritz_values;
+         arma::mat ritz_vectors;
+         if (!arma::eig_sym(ritz_values, ritz_vectors, arma::symmatu(Q.t() * BQ)))
+         {
+            break;
+         }
 
-         thread_elements.push_back(d);
+         const arma::vec top_values = arma::flipud(ritz_values.tail(k));
+         const arma::mat top_vectors = arma::fliplr(ritz_vectors.tail_cols(k));
 
-         if (col + 1 == matSize)
+         // The subspace holds the largest magnitude eigenvalues, so the top k
+         // are only correct if all of them are larger than anything it may
+         // have missed
+         const double scale = arma::max(arma::abs(ritz_values));
+         const double floor = arma::min(arma::abs(ritz_values));
+         const arma::mat residuals = BQ * top_vectors - Q * top_vectors * arma::diagmat(top_values);
+         if (scale > 0 && arma::max(arma::sqrt(arma::sum(arma::square(residuals), 0))) < mds_tolerance * scale
+               && top_values(k - 1) >= floor - mds_tolerance * scale)
          {
-            ++row;
-            col = row;
+            eigval = top_values;
+            eigvec = Q * top_vectors;
+            converged = 1;
+            break;
          }
+
+         arma::qr_econ(Q, R, BQ);
       }
 
-      // Set the thread off
-      distance_calculations.push(std::async(std::launch::async, threadDistance, thread_elements, std::cref(inMat)));
+      if (!converged)
+      {
+         std::cerr << "WARNING: Subspace iteration did not converge to the top " << k
+            << " eigenvalues. Calculating all eigenvalues instead\n";
+      }
    }
 
-   // Wait for thread results to return, and put the results in the distance
-   // matrix
-   while(!distance_calculations.empty())
+   if (!converged)
    {
-      std::vector<DistanceElement> distance_elements = distance_calculations.front().get();
-      distance_calculations.pop();
-
-      for(std::vector<DistanceElement>::iterator it = distance_elements.begin() ; it < distance_elements.end(); ++it)
+      if (!arma::eig_sym(eigval, eigvec, B))
       {
-         dist(it->row, it->col) = it->distance;
-         dist(it->col, it->row) = it->distance;
+         throw std::runtime_error("Could not calculate eigenvalues of B matrix in metric MDS");
       }
+
+      // Eigenvalues returned are sorted ascending, so want to reverse order
+      eigval = arma::flipud(eigval.tail(k));
+      eigvec = arma::fliplr(eigvec.tail_cols(k));
+   }
+}
+
+// B * Q for symmetric B, as (Q'B)' so each thread works on a contiguous
+// block of columns of B
+arma::mat symmetricProduct(const arma::mat& B, const arma::mat& Q, const unsigned int threads)
+{
+   arma::mat BQ(B.n_rows, Q.n_cols);
+
+   const size_t block_size = (B.n_cols + threads - 1) / threads;
+   std::vector<std::future<void>> blocks;
+   for (size_t first_col = 0; first_col < B.n_cols; first_col += block_size)
+   {
+      const size_t last_col = std::min(first_col + block_size, (size_t)B.n_cols) - 1;
+      blocks.push_back(std::async(std::launch::async, [&B, &Q, &BQ, first_col, last_col]
+      {
+         BQ.rows(first_col, last_col) = (Q.t() * B.cols(first_col, last_col)).t();
+      }));
+   }
+   for (auto& block : blocks)
+   {
+      block.get();
+   }
+
+   return BQ;
+}
+
+// Distance between all rows. 0/1 elements only
+arma::mat dissimiliarityMatrix(const arma::mat& inMat, const unsigned int threads)
+{
+   // Time parallelisation
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+   // The matrix product needs memory for a partial sum per thread, so
+   // distances are calculated pair by pair if it cannot be had
+   arma::mat dist;
+   try
+   {
+      dist = gramDistances(inMat, threads);
+   }
+   catch (std::exception& e)
+   {
+      std::cerr << "WARNING: Could not calculate distances as a matrix product (" << e.what()
+         << "). Calculating each pair instead\n";
+      dist = pairwiseDistances(inMat, threads);
    }
 
    // Normalise by total k-mers
@@ -149,19 +241,201 @@ arma::mat dissimiliarityMatrix(const arma::mat& inMat, const unsigned int thread
    return dist;
 }
 
-std::vector<DistanceElement> threadDistance(std::vector<DistanceElement> element_list, const arma::mat& rectangular_matrix)
+// Squared distance between all rows from the Gram matrix G = XX', as
+// |a - b|^2 = |a|^2 + |b|^2 - 2a.b. For 0/1 elements every sum is an integer,
+// so this is exact, and is the number of k-mers two samples differ by
+//
+// The product is split over blocks of k-mers (columns), with each thread
+// summing X_b X_b' for its block, so that a single threaded BLAS is still
+// used in parallel
+arma::mat gramDistances(const arma::mat& inMat, const unsigned int threads)
+{
+   const unsigned int matSize = inMat.n_rows;
+   const size_t block_cols = (inMat.n_cols + threads - 1) / threads;
+
+   std::vector<std::future<arma::mat>> partial_grams;
+   for (size_t first_col = 0; first_col < inMat.n_cols; first_col += block_cols)
+   {
+      const size_t num_cols = std::min(block_cols, (size_t)(inMat.n_cols - first_col));
+      partial_grams.push_back(std::async(std::launch::async, [&inMat, first_col, num_cols]()
+      {
+         // Columns are contiguous, so the block can be used without a copy
+         const arma::mat block(const_cast<double*>(inMat.colptr(first_col)), inMat.n_rows, num_cols, false, true);
+         return arma::mat(block * block.t());
+      }));
+   }
+
+   arma::mat gram = arma::zeros<arma::mat>(matSize, matSize);
+   for (auto it = partial_grams.begin(); it != partial_grams.end(); ++it)
+   {
+      gram += it->get();
+   }
+
+   const arma::vec norms = gram.diag();
+   arma::mat dist = -2 * gram;
+   dist.each_col() += norms;
+   dist.each_row() += norms.t();
+   dist.diag().zeros();
+
+   return dist;
+}
+
+// Squared distance between all rows, calculated pair by pair in tiles.
+// Slower than gramDistances, but needs no extra memory
+arma::mat pairwiseDistances(const arma::mat& inMat, const unsigned int threads)
+{
+   arma::mat dist = arma::zeros<arma::mat>(inMat.n_rows, inMat.n_rows);
+   tiledTriangle(inMat.n_rows, threads, [&inMat, &dist](const size_t first_row, const size_t first_col)
+   {
+      pairwiseTile(inMat, first_row, first_col, dist);
+   });
+
+   return dist;
+}
+
+// Number of k-mers each pair of samples differs by, as a popcount of the
+// XOR of their rows
+//
+// Within a tile the rows are worked through hamming_chunk_words at a time,
+// so each chunk of the tile's rows is read from cache rather than memory for
+// every pair
+arma::mat hammingDistances(const BitMatrix& bits, const unsigned int threads)
+{
+   arma::mat dist = arma::zeros<arma::mat>(bits.n_rows(), bits.n_rows());
+   tiledTriangle(bits.n_rows(), threads, [&bits, &dist](const size_t first_row, const size_t first_col)
+   {
+      hammingTile(bits, first_row, first_col, dist);
+   });
+
+   return dist;
+}
+
+// Calls tile_function(first_row, first_col) for each distance_tile_rows
+// square tile on or above the diagonal of a matSize square matrix.
+// Threads take the next tile from a shared counter whenever they finish one,
+// so the work stays balanced however long each tile takes. Each tile function
+// writes only its own tile and the tile's mirror image
+void tiledTriangle(const size_t matSize, const unsigned int threads, const std::function<void(size_t, size_t)>& tile_function)
+{
+   const size_t num_tiles = (matSize + distance_tile_rows - 1) / distance_tile_rows;
+   const size_t total_tiles = num_tiles * (num_tiles + 1) / 2;
+
+   // Index of the first tile in each row of tiles, counting along rows
+   std::vector<size_t> row_starts(num_tiles, 0);
+   for (size_t tile_row = 1; tile_row < num_tiles; ++tile_row)
+   {
+      row_starts[tile_row] = row_starts[tile_row - 1] + num_tiles - (tile_row - 1);
+   }
+
+   std::atomic<size_t> next_tile(0);
+   std::atomic<size_t> done_tiles(0);
+   std::vector<std::future<void>> workers;
+   for (unsigned int thread_idx = 0; thread_idx < threads; ++thread_idx)
+   {
+      workers.push_back(std::async(std::launch::async, [&]()
+      {
+         for (size_t tile = next_tile++; tile < total_tiles; tile = next_tile++)
+         {
+            const size_t tile_row = std::upper_bound(row_starts.begin(), row_starts.end(), tile) - row_starts.begin() - 1;
+            const size_t tile_col = tile_row + tile - row_starts[tile_row];
+            tile_function(tile_row * distance_tile_rows, tile_col * distance_tile_rows);
+
+            // Report every tenth of the way through large matrices
+            const size_t done = ++done_tiles;
+            if (total_tiles >= distance_progress_tiles && done * 10 / total_tiles > (done - 1) * 10 / total_tiles)
+            {
+               std::ostringstream progress;
+               progress << "\tCalculated " << done * 100 / total_tiles << "% of distances\n";
+               std::cerr << progress.str();
+            }
+         }
+      }));
+   }
+
+   for (auto it = workers.begin(); it != workers.end(); ++it)
+   {
+      it->get();
+   }
+}
+
+// Squared distances between the rows of one tile and the columns of another,
+// starting at rows first_row and first_col. Each column holds the tile's
+// rows contiguously, so the matrix is read a column at a time. Only pairs
+// above the diagonal are calculated, and written to both halves of dist
+void pairwiseTile(const arma::mat& inMat, const size_t first_row, const size_t first_col, arma::mat& dist)
+{
+   const size_t last_row = std::min(first_row + distance_tile_rows, (size_t)inMat.n_rows);
+   const size_t last_col = std::min(first_col + distance_tile_rows, (size_t)inMat.n_rows);
+
+   double sums[distance_tile_rows][distance_tile_rows] = {{0}};
+   for (size_t k = 0; k < inMat.n_cols; ++k)
+   {
+      const double* column = inMat.colptr(k);
+      for (size_t i = first_row; i < last_row; ++i)
+      {
+         for (size_t j = std::max(i + 1, first_col); j < last_col; ++j)
+         {
+            const double difference = column[i] - column[j];
+            sums[i - first_row][j - first_col] += difference * difference;
+         }
+      }
+   }
+
+   for (size_t i = first_row; i < last_row; ++i)
+   {
+      for (size_t j = std::max(i + 1, first_col); j < last_col; ++j)
+      {
+         dist(i, j) = sums[i - first_row][j - first_col];
+         dist(j, i) = dist(i, j);
+      }
+   }
+}
+
+// Distances between the rows of one tile and the columns of another,
+// starting at rows first_row and first_col. Only pairs above the diagonal are
+// calculated, and written to both halves of dist
+void hammingTile(const BitMatrix& bits, const size_t first_row, const size_t first_col, arma::mat& dist)
 {
-   for(std::vector<DistanceElement>::iterator it = element_list.begin() ; it != element_list.end(); ++it)
+   const size_t last_row = std::min(first_row + distance_tile_rows, bits.n_rows());
+   const size_t last_col = std::min(first_col + distance_tile_rows, bits.n_rows());
+
+   size_t counts[distance_tile_rows][distance_tile_rows] = {{0}};
+   for (size_t chunk = 0; chunk < bits.row_words(); chunk += hamming_chunk_words)
    {
-      it->distance = distanceFunction(rectangular_matrix.row(it->row), rectangular_matrix.row(it->col));
+      const size_t chunk_words = std::min(hamming_chunk_words, bits.row_words() - chunk);
+      for (size_t i = first_row; i < last_row; ++i)
+      {
+         for (size_t j = std::max(i + 1, first_col); j < last_col; ++j)
+         {
+            counts[i - first_row][j - first_col] += popcountXor(bits.row(i) + chunk, bits.row(j) + chunk, chunk_words);
+         }
+      }
    }
 
-   return element_list;
+   for (size_t i = first_row; i < last_row; ++i)
+   {
+      for (size_t j = std::max(i + 1, first_col); j < last_col; ++j)
+      {
+         dist(i, j) = counts[i - first_row][j - first_col];
+         dist(j, i) = dist(i, j);
+      }
+   }
 }
 
-double distanceFunction(const arma::rowvec& vec_1, const arma::rowvec& vec_2)
+// Dense 0/1 matrix of the first num_cols columns, e.g. to write out
+arma::mat unpackMatrix(const BitMatrix& bits, const size_t num_cols)
 {
-   // Slow
-   // return accu(abs(vec_1 - vec_2));
-   return dot(vec_1 - vec_2, vec_1 - vec_2);
+   arma::mat unpacked(bits.n_rows(), num_cols, arma::fill::zeros);
+   for (size_t i = 0; i < bits.n_rows(); ++i)
+   {
+      for (size_t j = 0; j < num_cols; ++j)
+      {
+         if (bits.test(i, j))
+         {
+            unpacked(i, j) = 1;
+         }
+      }
+   }
+
+   return unpacked;
 }
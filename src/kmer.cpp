@@ -43,90 +43,22 @@ std::ostream& operator<<(std::ostream &os, const Kmer& k)
    return os;
 }
 
-// Input
-std::istream& operator>>(std::istream &is, Kmer& k)
+// Set the x and maf of the kmer from an already known presence pattern
+void Kmer::add_x(const BitVector& presence)
 {
-   std::vector<std::string> samples;
-   std::string word, s_buffer, kmer_line;
-   char c_buffer;
-
-   /*
-    * Example dsm file line AAAAAAAAAAAAAAAAAATGCATATTTATCTTAG 5.172314 0.175087 100 0 100
-    * 0.164875 100 | 6925_3#7:9 6823_4#17:26 6871_2#9:8
-    *
-    * OR
-    *
-    * AAAAAAAAAAAAAAAAAATGCATATTTATCTTAG 5.172314 6925_3#7:9 6823_4#17:26 6871_2#9:8
-    *
-    */
-   if (is)
-   {
-      std::getline(is, kmer_line);
-      std::stringstream line(kmer_line);
-
-      // First field is the kmer
-      line >> word;
-
-      // Skip entropy fields
-      while (line >> s_buffer)
-      {
-         if (s_buffer == "|")
-         {
-            break;
-         }
-         // Gone one too far in a string w/out | separator
-         else
-         {
-            size_t occurence_pos = s_buffer.find(":");
-            if (s_buffer.find(":") != std::string::npos)
-            {
-               samples.push_back(s_buffer.substr(0, occurence_pos));
-               break;
-            }
-         }
-      }
-      s_buffer = "";
-
-      while (line >> c_buffer)
-      {
-         // Found end of sample. Read forward to next one
-         if (c_buffer == ':')
-         {
-            samples.push_back(s_buffer);
-            line >> s_buffer;
-
-            s_buffer = "";
-         }
-         else
-         {
-            s_buffer += c_buffer;
-         }
-      }
-   }
-
-   k = Kmer(word, samples);
+   _presence = presence;
 
-   return is;
+   _x_set = 1;
+   _maf = (double)num_occurrences()/presence.size();
 }
 
-// Set the x and maf of the kmer
-void Kmer::add_x(const std::unordered_map<std::string,int>& sample_map, const int num_samples)
+// Expand presence into a column of 0s and 1s, for use in a design matrix
+arma::vec Kmer::get_x() const
 {
-   _x.zeros(num_samples);
+   arma::vec x(_presence.size(), arma::fill::zeros);
+   _presence.for_each_set([&x](const size_t i) { x[i] = 1; });
 
-   for (auto it = _samples.begin(); it != _samples.end(); ++it)
-   {
-      auto sample_index_it = sample_map.find(*it);
-
-      if (sample_index_it != sample_map.end())
-      {
-         _x[sample_index_it->second] = 1;
-      }
-   }
-
-   // Set object values
-   _x_set = 1;
-   _maf = (double)num_occurrences()/num_samples;
+   return x;
 }
 
 // Add a new comment in
@@ -147,7 +79,7 @@ size_t Kmer::num_occurrences() const
    size_t total_occurrences;
    if (_x_set)
    {
-      total_occurrences = (int) accu(_x);
+      total_occurrences = _presence.count();
    }
    else
    {
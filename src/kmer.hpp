@@ -3,12 +3,11 @@
  * Header file for kmer class
  */
 
-#include <unordered_map>
-
 #define ARMA_DONT_PRINT_ERRORS
 #include <armadillo>
 
 #include "significant_kmer.hpp"
+#include "bitvector.hpp"
 
 const std::string kmer_seq_default = "";
 const std::vector<std::string> kmer_occ_default;
@@ -30,28 +29,31 @@ class Kmer: public Significant_kmer
       // nonmodifying operations
       int length() const { return _word.length(); }
       size_t num_occurrences() const;
-      std::string occurrence(int i) const { return _samples[i]; }
-      std::vector<std::string> occurrence_vector() const { return _samples; }
-      arma::vec get_x() const { return _x; }
+      arma::vec get_x() const; // this is defined in kmer.cpp
+      const BitVector& presence() const { return _presence; }
       int has_x() const { return _x_set; }
       double log_likelihood() const { return _log_likelihood; }
       int firth() const { return _use_firth; }
 
       // Modifying operations
       void add_comment(const std::string& new_comment); // this is defined in kmer.cpp
-      void add_x(const std::unordered_map<std::string,int>& sample_map, const int num_samples); // this is defined in kmer.cpp
+      void add_x(const BitVector& presence); // this is defined in kmer.cpp
       void log_likelihood(const double ll) { _log_likelihood = ll; }
       void firth(const int use_firth) { _use_firth = use_firth; }
+      using Significant_kmer::comments;
+      void comments(const std::string& comment) { _comment = comment; }
+      using Significant_kmer::covar_p;
+      void covar_p(const std::vector<double>& covar_p) { _covar_p = covar_p; }
 
    private:
-      arma::vec _x;
+      // Samples the k-mer is present in, in the same order as the samples
+      // vector. The dense design column is only made by get_x()
+      BitVector _presence;
       int _x_set;
       double _log_likelihood;
       int _use_firth;
 
 };
 
-// Overload output and input operators
+// Overload output operator. k-mers are read with DsmReader
 std::ostream& operator<<(std::ostream &os, const Kmer& k);
-
-std::istream& operator>>(std::istream &is, Kmer& k);
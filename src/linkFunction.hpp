@@ -5,6 +5,8 @@
 
 #include "seercommon.hpp"
 
+// The predictors and responses are held by reference, so must outlive the
+// functor
 class LinkFunction
 {
    public:
@@ -21,8 +23,8 @@ class LinkFunction
          const;
 
    protected:
-      arma::mat predictors;
-      arma::vec responses;
+      const arma::mat& predictors;
+      const arma::vec& responses;
 
       double lambda;
 };
@@ -49,6 +51,62 @@ class LogitLikelihoodGradient : public LinkFunction
       column_vector operator() (const column_vector& parameters_in) const;
 };
 
+// The logit likelihood and its gradient from a single pass over the samples.
+// The results for the last parameters are kept, as dlib asks for the
+// likelihood then the gradient at the same point
+class LogitObjective : public LinkFunction
+{
+   public:
+      LogitObjective(const arma::mat& _predictors, const arma::vec& _responses, const double _lambda = 0)
+         : LinkFunction(_predictors, _responses, _lambda), _evaluated(0), _log_likelihood(0)
+      {
+      }
+
+      // These are defined in logitFunction.cpp
+      double likelihood(const column_vector& parameters_in) const;
+      column_vector gradient(const column_vector& parameters_in) const;
+
+   private:
+      void evaluate(const column_vector& parameters_in) const;
+
+      mutable int _evaluated;
+      mutable arma::vec _parameters;
+      mutable arma::vec _exponents;
+      mutable arma::vec _residuals;
+      mutable double _log_likelihood;
+      mutable column_vector _gradient;
+};
+
+// Pass a LogitObjective to the dlib optimisers, which take the likelihood and
+// gradient as separate functors
+class LogitObjectiveLikelihood
+{
+   public:
+      LogitObjectiveLikelihood(const LogitObjective& objective)
+         : _objective(objective)
+      {
+      }
+
+      double operator() (const column_vector& parameters_in) const { return _objective.likelihood(parameters_in); }
+
+   private:
+      const LogitObjective& _objective;
+};
+
+class LogitObjectiveGradient
+{
+   public:
+      LogitObjectiveGradient(const LogitObjective& objective)
+         : _objective(objective)
+      {
+      }
+
+      column_vector operator() (const column_vector& parameters_in) const { return _objective.gradient(parameters_in); }
+
+   private:
+      const LogitObjective& _objective;
+};
+
 class LinearLikelihood : public LinkFunction
 {
    public:
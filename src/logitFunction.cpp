@@ -75,3 +75,60 @@ column_vector LogitLikelihoodGradient::operator()(const column_vector& parameter
    return arma_to_dlib(gradient);
 }
 
+
+// Fused versions of the above
+double LogitObjective::likelihood(const column_vector& parameters_in) const
+{
+   evaluate(parameters_in);
+   return _log_likelihood;
+}
+
+column_vector LogitObjective::gradient(const column_vector& parameters_in) const
+{
+   evaluate(parameters_in);
+   return _gradient;
+}
+
+// Computes the linear predictor once, then in a single pass the sigmoids,
+// residuals and log-likelihood. With eta = w'x,
+//   log(sig(eta)) = -log(1 + exp(-eta))
+//   log(1 - sig(eta)) = -log(1 + exp(eta))
+// and log(1 + exp(t)) = max(t, 0) + log1p(exp(-|t|)) does not overflow
+void LogitObjective::evaluate(const column_vector& parameters_in) const
+{
+   // View the dlib vector's memory, rather than copying it
+   const arma::vec parameters(const_cast<double*>(&parameters_in(0)), parameters_in.nr(), false, true);
+   if (_evaluated && _parameters.n_elem == parameters.n_elem && arma::accu(parameters != _parameters) == 0)
+   {
+      return;
+   }
+
+   _parameters = parameters;
+   _exponents = predictors * parameters;
+   _residuals.set_size(responses.n_elem);
+
+   double result = 0;
+   for (size_t i = 0; i < responses.n_elem; ++i)
+   {
+      const double eta = _exponents[i];
+      const double soft_plus = std::max(eta, 0.0) + std::log1p(std::exp(-std::abs(eta))); // log(1 + exp(eta))
+
+      result += responses[i] * eta - soft_plus;
+      _residuals[i] = responses[i] - std::exp(eta - soft_plus);
+   }
+
+   arma::vec gradient = predictors.t() * _residuals;
+
+   // For the regularization, we ignore the first term, which is the intercept
+   // term.
+   if (parameters.n_elem > 1 && lambda > 0)
+   {
+      const arma::vec b = parameters.subvec(1, parameters.n_elem - 1);
+      result -= 0.5 * lambda * arma::dot(b, b);
+      gradient.subvec(1, parameters.n_elem - 1) -= lambda * b;
+   }
+
+   _log_likelihood = result;
+   _gradient = arma_to_dlib(gradient);
+   _evaluated = 1;
+}
@@ -0,0 +1,310 @@
+/*
+ * File: popcount.cpp
+ *
+ * Population count kernels for packed bit vectors, with AVX-512 and AVX2
+ * versions picked at run time
+ *
+ */
+
+#include "popcount.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SEER_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+typedef size_t (*popcount_kernel)(const uint64_t*, const size_t);
+typedef size_t (*popcount_and_kernel)(const uint64_t*, const uint64_t*, const size_t);
+typedef size_t (*popcount_xor_kernel)(const uint64_t*, const uint64_t*, const size_t);
+
+// Portable versions, also used to finish off the tails of vector versions
+static size_t popcountScalar(const uint64_t* a, const size_t n_words)
+{
+   size_t total = 0;
+   for (size_t i = 0; i < n_words; ++i)
+   {
+      total += __builtin_popcountll(a[i]);
+   }
+   return total;
+}
+
+static size_t popcountAndScalar(const uint64_t* a, const uint64_t* b, const size_t n_words)
+{
+   size_t total = 0;
+   for (size_t i = 0; i < n_words; ++i)
+   {
+      total += __builtin_popcountll(a[i] & b[i]);
+   }
+   return total;
+}
+
+static size_t popcountXorScalar(const uint64_t* a, const uint64_t* b, const size_t n_words)
+{
+   size_t total = 0;
+   for (size_t i = 0; i < n_words; ++i)
+   {
+      total += __builtin_popcountll(a[i] ^ b[i]);
+   }
+   return total;
+}
+
+#ifdef SEER_X86_KERNELS
+// As above, but using the popcnt instruction rather than a bit twiddling
+// library call
+__attribute__((target("popcnt")))
+static size_t popcountHw(const uint64_t* a, const size_t n_words)
+{
+   size_t total = 0;
+   for (size_t i = 0; i < n_words; ++i)
+   {
+      total += __builtin_popcountll(a[i]);
+   }
+   return total;
+}
+
+__attribute__((target("popcnt")))
+static size_t popcountAndHw(const uint64_t* a, const uint64_t* b, const size_t n_words)
+{
+   size_t total = 0;
+   for (size_t i = 0; i < n_words; ++i)
+   {
+      total += __builtin_popcountll(a[i] & b[i]);
+   }
+   return total;
+}
+
+__attribute__((target("popcnt")))
+static size_t popcountXorHw(const uint64_t* a, const uint64_t* b, const size_t n_words)
+{
+   size_t total = 0;
+   for (size_t i = 0; i < n_words; ++i)
+   {
+      total += __builtin_popcountll(a[i] ^ b[i]);
+   }
+   return total;
+}
+
+// AVX2 has no popcount instruction. Count each nibble with a shuffle lookup,
+// then sum the bytes in each 64-bit lane
+// See: Mula, Kurz & Lemire (2018) doi:10.1093/comjnl/bxx046
+__attribute__((target("avx2")))
+static inline __m256i popcount256(const __m256i v)
+{
+   const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                           0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+   const __m256i low_mask = _mm256_set1_epi8(0x0f);
+
+   const __m256i lo = _mm256_and_si256(v, low_mask);
+   const __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask);
+   const __m256i counts = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo), _mm256_shuffle_epi8(lookup, hi));
+
+   return _mm256_sad_epu8(counts, _mm256_setzero_si256());
+}
+
+__attribute__((target("avx2")))
+static size_t sum256(const __m256i v)
+{
+   return _mm256_extract_epi64(v, 0) + _mm256_extract_epi64(v, 1)
+      + _mm256_extract_epi64(v, 2) + _mm256_extract_epi64(v, 3);
+}
+
+__attribute__((target("avx2")))
+static size_t popcountAvx2(const uint64_t* a, const size_t n_words)
+{
+   __m256i total = _mm256_setzero_si256();
+
+   size_t i = 0;
+   for (; i + 4 <= n_words; i += 4)
+   {
+      const __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+      total = _mm256_add_epi64(total, popcount256(va));
+   }
+
+   return sum256(total) + popcountScalar(a + i, n_words - i);
+}
+
+__attribute__((target("avx2")))
+static size_t popcountAndAvx2(const uint64_t* a, const uint64_t* b, const size_t n_words)
+{
+   __m256i total = _mm256_setzero_si256();
+
+   size_t i = 0;
+   for (; i + 4 <= n_words; i += 4)
+   {
+      const __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+      const __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+      total = _mm256_add_epi64(total, popcount256(_mm256_and_si256(va, vb)));
+   }
+
+   return sum256(total) + popcountAndScalar(a + i, b + i, n_words - i);
+}
+
+__attribute__((target("avx2")))
+static size_t popcountXorAvx2(const uint64_t* a, const uint64_t* b, const size_t n_words)
+{
+   __m256i total = _mm256_setzero_si256();
+
+   size_t i = 0;
+   for (; i + 4 <= n_words; i += 4)
+   {
+      const __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+      const __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+      total = _mm256_add_epi64(total, popcount256(_mm256_xor_si256(va, vb)));
+   }
+
+   return sum256(total) + popcountXorScalar(a + i, b + i, n_words - i);
+}
+
+// AVX-512 with VPOPCNTDQ counts each 64-bit lane directly. The tail is
+// loaded with a mask, so needs no scalar loop
+__attribute__((target("avx512f")))
+static size_t sum512(const __m512i v)
+{
+   uint64_t lanes[8];
+   _mm512_storeu_si512(lanes, v);
+
+   size_t total = 0;
+   for (int i = 0; i < 8; ++i)
+   {
+      total += lanes[i];
+   }
+   return total;
+}
+
+__attribute__((target("avx512f,avx512vpopcntdq")))
+static size_t popcountAvx512(const uint64_t* a, const size_t n_words)
+{
+   __m512i total = _mm512_setzero_si512();
+
+   size_t i = 0;
+   for (; i + 8 <= n_words; i += 8)
+   {
+      total = _mm512_add_epi64(total, _mm512_popcnt_epi64(_mm512_loadu_si512(a + i)));
+   }
+
+   const __mmask8 tail = (__mmask8)((1u << (n_words - i)) - 1);
+   total = _mm512_add_epi64(total, _mm512_popcnt_epi64(_mm512_maskz_loadu_epi64(tail, a + i)));
+
+   return sum512(total);
+}
+
+__attribute__((target("avx512f,avx512vpopcntdq")))
+static size_t popcountAndAvx512(const uint64_t* a, const uint64_t* b, const size_t n_words)
+{
+   __m512i total = _mm512_setzero_si512();
+
+   size_t i = 0;
+   for (; i + 8 <= n_words; i += 8)
+   {
+      const __m512i both = _mm512_and_si512(_mm512_loadu_si512(a + i), _mm512_loadu_si512(b + i));
+      total = _mm512_add_epi64(total, _mm512_popcnt_epi64(both));
+   }
+
+   const __mmask8 tail = (__mmask8)((1u << (n_words - i)) - 1);
+   const __m512i both = _mm512_and_si512(_mm512_maskz_loadu_epi64(tail, a + i), _mm512_maskz_loadu_epi64(tail, b + i));
+   total = _mm512_add_epi64(total, _mm512_popcnt_epi64(both));
+
+   return sum512(total);
+}
+
+__attribute__((target("avx512f,avx512vpopcntdq")))
+static size_t popcountXorAvx512(const uint64_t* a, const uint64_t* b, const size_t n_words)
+{
+   __m512i total = _mm512_setzero_si512();
+
+   size_t i = 0;
+   for (; i + 8 <= n_words; i += 8)
+   {
+      const __m512i either = _mm512_xor_si512(_mm512_loadu_si512(a + i), _mm512_loadu_si512(b + i));
+      total = _mm512_add_epi64(total, _mm512_popcnt_epi64(either));
+   }
+
+   const __mmask8 tail = (__mmask8)((1u << (n_words - i)) - 1);
+   const __m512i either = _mm512_xor_si512(_mm512_maskz_loadu_epi64(tail, a + i), _mm512_maskz_loadu_epi64(tail, b + i));
+   total = _mm512_add_epi64(total, _mm512_popcnt_epi64(either));
+
+   return sum512(total);
+}
+#endif
+
+// Pick the widest kernels this CPU can run
+static popcount_kernel choosePopcount()
+{
+   popcount_kernel kernel = popcountScalar;
+#ifdef SEER_X86_KERNELS
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vpopcntdq"))
+   {
+      kernel = popcountAvx512;
+   }
+   else if (__builtin_cpu_supports("avx2"))
+   {
+      kernel = popcountAvx2;
+   }
+   else if (__builtin_cpu_supports("popcnt"))
+   {
+      kernel = popcountHw;
+   }
+#endif
+   return kernel;
+}
+
+static popcount_and_kernel choosePopcountAnd()
+{
+   popcount_and_kernel kernel = popcountAndScalar;
+#ifdef SEER_X86_KERNELS
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vpopcntdq"))
+   {
+      kernel = popcountAndAvx512;
+   }
+   else if (__builtin_cpu_supports("avx2"))
+   {
+      kernel = popcountAndAvx2;
+   }
+   else if (__builtin_cpu_supports("popcnt"))
+   {
+      kernel = popcountAndHw;
+   }
+#endif
+   return kernel;
+}
+
+static popcount_xor_kernel choosePopcountXor()
+{
+   popcount_xor_kernel kernel = popcountXorScalar;
+#ifdef SEER_X86_KERNELS
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vpopcntdq"))
+   {
+      kernel = popcountXorAvx512;
+   }
+   else if (__builtin_cpu_supports("avx2"))
+   {
+      kernel = popcountXorAvx2;
+   }
+   else if (__builtin_cpu_supports("popcnt"))
+   {
+      kernel = popcountXorHw;
+   }
+#endif
+   return kernel;
+}
+
+size_t popcount(const uint64_t* a, const size_t n_words)
+{
+   static const popcount_kernel kernel = choosePopcount();
+   return kernel(a, n_words);
+}
+
+size_t popcountAnd(const uint64_t* a, const uint64_t* b, const size_t n_words)
+{
+   static const popcount_and_kernel kernel = choosePopcountAnd();
+   return kernel(a, b, n_words);
+}
+
+size_t popcountXor(const uint64_t* a, const uint64_t* b, const size_t n_words)
+{
+   static const popcount_xor_kernel kernel = choosePopcountXor();
+   return kernel(a, b, n_words);
+}
@@ -0,0 +1,14 @@
+/*
+ * popcount.hpp
+ * Header file for population count kernels on packed bit vectors
+ */
+
+#include <cstdint>
+#include <cstddef>
+
+// Number of set bits in a, in (a AND b), and in (a XOR b), over n_words
+// 64-bit words. Use AVX-512 or AVX2 where the CPU supports it, chosen at run
+// time
+size_t popcount(const uint64_t* a, const size_t n_words);
+size_t popcountAnd(const uint64_t* a, const uint64_t* b, const size_t n_words);
+size_t popcountXor(const uint64_t* a, const uint64_t* b, const size_t n_words);
@@ -0,0 +1,93 @@
+/*
+ * File: resultCache.cpp
+ *
+ * Helper functions for the resultCache class
+ *
+ */
+
+#include "seer.hpp"
+
+// Copy out the pattern dependent fields of a tested k-mer
+AssocResult storeResult(const Kmer& k)
+{
+   AssocResult result;
+   result.chisq_p = k.unadj();
+   result.wald_p = k.p_val();
+   result.lrt_p = k.lrt_p_val();
+   result.beta = k.beta();
+   result.se = k.se();
+   result.log_likelihood = k.log_likelihood();
+   result.covar_p = k.covar_p();
+   result.comment = k.comments();
+
+   return result;
+}
+
+// Fill in a k-mer as if it had been tested. Its sequence, samples and line
+// are kept
+void applyResult(const AssocResult& result, Kmer& k)
+{
+   k.unadj_p_val(result.chisq_p);
+   k.p_val(result.wald_p);
+   k.lrt_p_val(result.lrt_p);
+   k.beta(result.beta);
+   k.standard_error(result.se);
+   k.log_likelihood(result.log_likelihood);
+   k.covar_p(result.covar_p);
+   k.comments(result.comment);
+}
+
+ResultCache::ResultCache(const size_t max_patterns)
+   :_max_patterns(max_patterns), _hits(0), _misses(0)
+{
+}
+
+// Returns true and sets result if pattern has been seen recently
+bool ResultCache::find(const BitVector& pattern, AssocResult& result)
+{
+   std::lock_guard<std::mutex> lock(_mutex);
+
+   int found = 0;
+   auto index_it = _index.find(std::cref(pattern));
+   if (index_it != _index.end())
+   {
+      // Move to front of the list. Iterators stay valid
+      _entries.splice(_entries.begin(), _entries, index_it->second);
+      result = index_it->second->second;
+
+      found = 1;
+      _hits++;
+   }
+   else
+   {
+      _misses++;
+   }
+
+   return found;
+}
+
+void ResultCache::insert(const BitVector& pattern, const AssocResult& result)
+{
+   std::lock_guard<std::mutex> lock(_mutex);
+
+   // Another thread may have tested the same pattern in the meantime
+   if (_max_patterns > 0 && _index.find(std::cref(pattern)) == _index.end())
+   {
+      if (_entries.size() >= _max_patterns)
+      {
+         _index.erase(std::cref(_entries.back().first));
+         _entries.pop_back();
+      }
+
+      _entries.push_front(std::make_pair(pattern, result));
+      _index[std::cref(_entries.front().first)] = _entries.begin();
+   }
+}
+
+// k-mers given the result of an earlier k-mer in their batch with the same
+// pattern, which could not yet be in the cache
+void ResultCache::reused(const long int num_kmers)
+{
+   std::lock_guard<std::mutex> lock(_mutex);
+   _hits += num_kmers;
+}
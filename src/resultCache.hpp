@@ -0,0 +1,56 @@
+/*
+ * resultCache.hpp
+ * Header file for resultCache class
+ */
+
+#include <list>
+#include <functional>
+#include <mutex>
+
+// The parts of a tested k-mer which depend only on its presence pattern
+struct AssocResult
+{
+   double chisq_p;
+   double wald_p;
+   double lrt_p;
+   double beta;
+   double se;
+   double log_likelihood;
+   std::vector<double> covar_p;
+   std::string comment;
+};
+
+AssocResult storeResult(const Kmer& k);
+void applyResult(const AssocResult& result, Kmer& k);
+
+// Bounded cache of association results, keyed on k-mer presence pattern.
+// When full, the least recently used pattern is dropped. Safe to share
+// between threads
+class ResultCache
+{
+   public:
+      // Initialisation
+      ResultCache(const size_t max_patterns);
+
+      // nonmodifying operations
+      long int hits() const { return _hits; }
+      long int misses() const { return _misses; }
+
+      // Modifying operations
+      bool find(const BitVector& pattern, AssocResult& result); // this is defined in resultCache.cpp
+      void insert(const BitVector& pattern, const AssocResult& result); // this is defined in resultCache.cpp
+      void reused(const long int num_kmers); // this is defined in resultCache.cpp. Counts results shared without a lookup
+
+   private:
+      // Most recently used at the front. The index refers to the patterns
+      // held in the list, so they are not stored twice
+      typedef std::list<std::pair<BitVector, AssocResult>> lru_list;
+      lru_list _entries;
+      std::unordered_map<std::reference_wrapper<const BitVector>, lru_list::iterator, BitVectorHash, std::equal_to<BitVector>> _index;
+
+      size_t _max_patterns;
+      long int _hits;
+      long int _misses;
+
+      std::mutex _mutex;
+};
@@ -0,0 +1,71 @@
+/*
+ * File: sampleIndex.cpp
+ *
+ * Helper functions for the sampleIndex class
+ *
+ */
+
+#include "seercommon.hpp"
+
+#include <cstring>
+
+SampleIndex::SampleIndex()
+   :_offsets(1, 0)
+{
+}
+
+SampleIndex::SampleIndex(const std::vector<Sample>& samples)
+   :_offsets(1, 0)
+{
+   _offsets.reserve(samples.size() + 1);
+   for (auto it = samples.begin(); it != samples.end(); ++it)
+   {
+      _names += it->iid();
+      _offsets.push_back(_names.size());
+   }
+}
+
+SampleIndex::SampleIndex(const std::vector<std::string>& names)
+   :_offsets(1, 0)
+{
+   _offsets.reserve(names.size() + 1);
+   for (auto it = names.begin(); it != names.end(); ++it)
+   {
+      _names += *it;
+      _offsets.push_back(_names.size());
+   }
+}
+
+// Binary search of the sorted names, comparing as std::string does
+int SampleIndex::find(const char* name, const size_t length) const
+{
+   int found = -1;
+
+   size_t lower = 0, upper = size();
+   while (lower < upper && found == -1)
+   {
+      const size_t mid = lower + (upper - lower) / 2;
+      const size_t mid_length = _offsets[mid+1] - _offsets[mid];
+
+      int cmp = memcmp(_names.data() + _offsets[mid], name, std::min(mid_length, length));
+      if (cmp == 0)
+      {
+         cmp = (mid_length > length) - (mid_length < length);
+      }
+
+      if (cmp == 0)
+      {
+         found = mid;
+      }
+      else if (cmp < 0)
+      {
+         lower = mid + 1;
+      }
+      else
+      {
+         upper = mid;
+      }
+   }
+
+   return found;
+}
@@ -0,0 +1,32 @@
+/*
+ * sampleIndex.hpp
+ * Header file for sampleIndex class
+ */
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+// Sample names from the pheno file, interned so that names in the dsm file
+// can be resolved to sample indices without making a string for each.
+// Names are kept sorted in a single buffer, so the index of a sample is its
+// position in the (sorted) samples vector
+class SampleIndex
+{
+   public:
+      // Initialisation
+      SampleIndex();
+      SampleIndex(const std::vector<Sample>& samples); // samples must be sorted by name
+      SampleIndex(const std::vector<std::string>& names); // names must be sorted
+
+      // nonmodifying operations
+      size_t size() const { return _offsets.size() - 1; }
+      int find(const char* name, const size_t length) const; // this is defined in sampleIndex.cpp. Returns -1 if not found
+      std::string name(const size_t i) const { return _names.substr(_offsets[i], _offsets[i+1] - _offsets[i]); }
+      void write_name(std::ostream& os, const size_t i) const { os.write(_names.data() + _offsets[i], _offsets[i+1] - _offsets[i]); }
+      bool operator==(const SampleIndex& other) const { return _offsets == other._offsets && _names == other._names; }
+
+   private:
+      std::string _names;
+      std::vector<size_t> _offsets; // name i is _names[_offsets[i], _offsets[i+1])
+};
@@ -11,6 +11,15 @@
 
 // dlib headers
 #include <dlib/optimization.h>
+#include "stopStrategy.hpp"
+
+#include <atomic>
+
+// Queues between threads
+#include "threadQueue.hpp"
+
+// Reuse of results between k-mers with the same presence pattern
+#include "resultCache.hpp"
 
 // Constants
 //    Default options
@@ -23,32 +32,185 @@ const double se_limit = 3;
 // Should be >0. This value is based on RMS in example study
 const double bfgs_start_beta = 1;
 
+// Number of k-mers tested together by a thread
+const unsigned int batch_size = 256;
+
+// Number of k-mers advanced through Newton-Raphson together in a logistic
+// batch fit, and the iterations allowed before they are fitted on their own
+const unsigned int logit_block_size = 64;
+const unsigned int max_batch_iterations = 25;
+
+// Number of batches which may be queued or awaiting output, per testing thread
+const unsigned int queue_depth = 4;
+
+// Number of presence patterns to keep results for
+const long int cache_size_default = 50000;
+
+// Structs
+// Fit of the model without the k-mer (intercept and covariates only), which
+// is the same for every k-mer
+struct NullModel
+{
+   double log_likelihood;
+   arma::vec beta; // empty if the fit did not converge
+   arma::vec residuals; // y - fitted values
+   arma::mat inv_information; // (X'WX)^-1, or (X'X)^-1 for linear fits
+   arma::mat design; // X: intercept and covariates
+
+   // Logistic fits only, for the score test
+   arma::vec weights; // p(1-p)
+   arma::mat weighted_design_t; // (WX)', so each sample is a column
+   arma::mat design_products; // X(:,a) % X(:,b) for each a <= b, for batch fits
+
+   // Linear fits only, for projecting out the covariates. X = QR
+   arma::mat q_t; // Q', so each sample is a column
+   arma::mat r_inv;
+};
+
+// Iteration counts of the logistic fits, summed over all threads
+struct FitStats
+{
+   FitStats()
+      : batch_fits(0), batch_iterations(0), bfgs_fits(0), bfgs_iterations(0)
+   {
+   }
+
+   std::atomic<long int> batch_fits;
+   std::atomic<long int> batch_iterations;
+   std::atomic<long int> bfgs_fits;
+   std::atomic<long int> bfgs_iterations;
+};
+
+// Data shared between all association testing threads. Read only once set up
+struct AssocModel
+{
+   arma::vec y;
+   SampleIndex samples; // in the same order as y
+   BitVector cases; // binary phenotypes only
+   arma::mat mds;
+   int use_mds;
+   int continuous;
+   double null_ll;
+   NullModel null_model;
+
+   int score_test; // screen binary phenotypes with a score test first
+   double score_cutoff;
+
+   ResultCache* cache; // NULL if not caching
+   FitStats* fit_stats;
+};
+
+// k-mers are passed between threads in batches, numbered in input order, so
+// that a thread can fit many k-mers at once. Each phenotype tests its own
+// copy of the k-mers which pass its filters; the last moves them out of
+// kmers rather than copying
+struct KmerBatch
+{
+   long int batch_nr;
+   std::vector<Kmer> kmers; // passing the basic filters
+   std::vector<std::vector<Kmer>> tested; // for each phenotype, with results
+
+   long int line_number() const { return batch_nr; }
+};
+
+// The k-mers of a batch one phenotype is testing, by how far they get
+struct PhenotypeBatch
+{
+   std::vector<Kmer*> tested; // not found in the cache
+   std::vector<Kmer*> to_fit; // not screened out either
+   std::vector<size_t> fit_positions; // of each of to_fit in the batch
+   std::vector<std::pair<Kmer*, const Kmer*>> duplicates; // k-mer, and the earlier k-mer in tested with its pattern
+};
+
+// Presence of the k-mers in a batch which continuous phenotypes need to fit,
+// with the covariates projected out. The covariates are the same for every
+// phenotype, so this is done once per batch
+struct ProjectedBatch
+{
+   std::vector<long int> columns; // for each k-mer in the batch, -1 if not projected
+   arma::mat x_block;
+   arma::rowvec sxx; // rx'rx
+   arma::mat g; // R^-1 Q'x
+};
+
+// Unique presence patterns of the k-mers to be tested, found in the first
+// pass over the k-mer file with --dedup_patterns
+struct PatternTable
+{
+   std::unordered_map<BitVector, size_t, BitVectorHash> index; // position in results
+   std::vector<AssocResult> results;
+};
+
 // seerCmdLine headers
 int parseCommandLine (int argc, char *argv[], boost::program_options::variables_map& vm);
 void printHelp(boost::program_options::options_description& help);
 
 // seerStats headers
-double chiTest(Kmer& k, const arma::vec& y);
+double chiTest(Kmer& k, const BitVector& cases);
 double welchTwoSamplet(const Kmer& k, const arma::vec& y);
-double nullLogLikelihood(const arma::mat& x, const arma::vec& y, const int continuous);
+double nullLogLikelihood(const arma::mat& x, const arma::vec& y, const int continuous, NullModel& null_model);
 double likelihoodRatioTest(Kmer& k, const double null_ll, const int continuous = 0);
 double normalPval(double testStatistic);
+arma::mat presenceMatrix(const std::vector<Kmer*>& kmers, const size_t num_samples);
+void fillPresence(const Kmer& k, double* col);
 
-int passStatsFilters(const cmdOptions& filterOptions, Kmer& k, const arma::vec& y, const int continuous_phenotype);
+int passStatsFilters(const cmdOptions& filterOptions, Kmer& k, const AssocModel& model);
 
 // seerBinaryAssoc headers
-void logisticTest(Kmer& k, const arma::vec& y, const double null_ll);
-void logisticTest(Kmer& k, const arma::vec& y_train, const double null_ll, const arma::mat& mds);
+void logisticTest(Kmer& k, const arma::vec& y_train, const NullModel& null_model, FitStats* fit_stats, const arma::mat& x_design);
+
+void scoreTest(Kmer& k, const NullModel& null_model);
+
+std::vector<Kmer*> logisticBatch(const std::vector<Kmer*>& kmers, const arma::vec& y_train, const NullModel& null_model, FitStats* fit_stats);
+void logisticBlock(const std::vector<Kmer*>& block, const arma::vec& y_train, const NullModel& null_model, FitStats* fit_stats, std::vector<Kmer*>& unfitted);
+arma::mat blockInformation(const arma::vec& I_covar, const arma::vec& I_cross, const double I_kmer, const arma::uvec& full_index);
+int logisticResult(Kmer& k, const arma::vec& b, const arma::mat& var_covar_mat, const arma::vec& linear_pred, const arma::vec& y_train, const double null_ll);
 
-void doLogit(Kmer& k, const arma::vec& y_train, const arma::mat& x_design);
+void doLogit(Kmer& k, const arma::vec& y_train, const arma::mat& x_design, const arma::vec& null_beta = arma::vec(), FitStats* fit_stats = NULL);
 void newtonRaphson(Kmer& k, const arma::vec& y_train, const arma::mat& x_design, const bool firth = 0);
 
 arma::mat varCovarMat(const arma::mat& x, const arma::mat& b);
 arma::vec predictLogitProbs(const arma::mat& x, const arma::vec& b);
 
 // seerContinuousAssoc headers
-void linearTest(Kmer& k, const arma::vec& y_train, const double null_ll);
-void linearTest(Kmer& k, const arma::vec& y_train, const double null_ll, const arma::mat& mds);
+void linearTest(Kmer& k, const arma::vec& y_train, const NullModel& null_model, const arma::mat& x_design);
+
+void projectedLinear(Kmer& k, const NullModel& null_model);
+void linearBatch(const std::vector<Kmer*>& kmers, const std::vector<size_t>& positions, const ProjectedBatch& projected, const NullModel& null_model);
+void projectedResult(Kmer& k, const double sxx, const double x_resid, const arma::vec& g, const NullModel& null_model);
 
 void doLinear(Kmer& k, const arma::vec& y_train, const arma::mat& x_design);
 
+// seerPipeline headers
+void pipelineAssoc(const cmdOptions& parameters, const std::vector<AssocModel>& models, const std::vector<std::ostream*>& outputs,
+      long int& input_line, std::vector<long int>& tested_kmers, std::vector<long int>& significant_kmers);
+void readKmers(DsmReader& kmer_file, const cmdOptions& parameters, const SampleIndex& samples,
+      BoundedQueue<KmerBatch>& kmer_queue, ReorderBuffer<KmerBatch>& results, long int& input_line);
+void sendBatch(KmerBatch& batch, BoundedQueue<KmerBatch>& kmer_queue, ReorderBuffer<KmerBatch>& results);
+void writeKmers(ReorderBuffer<KmerBatch>& results, const cmdOptions& parameters, const std::vector<AssocModel>& models,
+      const std::vector<std::ostream*>& outputs, std::vector<long int>& tested_kmers, std::vector<long int>& significant_kmers);
+int passFilters(const cmdOptions& parameters, Kmer& k, const AssocModel& model);
+void testBatch(KmerBatch& batch, const cmdOptions& parameters, const std::vector<AssocModel>& models, arma::mat& x_design);
+void filterBatch(std::vector<Kmer>& kmers, const cmdOptions& parameters, const AssocModel& model,
+      std::vector<Kmer>& tested, PhenotypeBatch& stages, const int last_phenotype);
+void projectBatch(const size_t num_kmers, const std::vector<AssocModel>& models, const std::vector<PhenotypeBatch>& stages,
+      ProjectedBatch& projected);
+int cachedResult(Kmer& k, const AssocModel& model);
+int scoreScreen(Kmer& k, const AssocModel& model);
+void fitBatch(const std::vector<Kmer*>& kmers, const std::vector<size_t>& positions, const AssocModel& model,
+      arma::mat& x_design, const ProjectedBatch& projected);
+void fitKmer(Kmer& k, const AssocModel& model, arma::mat& x_design);
+arma::mat designWorkspace(const AssocModel& model);
+void finishAssoc(Kmer& k, const AssocModel& model);
+void assocWorker(BoundedQueue<KmerBatch>& kmer_queue, ReorderBuffer<KmerBatch>& results, const cmdOptions& parameters,
+      const std::vector<AssocModel>& models);
+void writeHeader(std::ostream& os, const cmdOptions& parameters, const AssocModel& model);
+int printKmer(std::ostream& os, const Kmer& k, const cmdOptions& parameters, const SampleIndex& samples);
+
+// seerDedup headers
+void dedupAssoc(const cmdOptions& parameters, const std::vector<AssocModel>& models,
+      long int& input_line, long int& tested_kmers, long int& significant_kmers);
+void collectPatterns(DsmReader& kmer_file, const cmdOptions& parameters, const AssocModel& model,
+      PatternTable& patterns, long int& input_line, long int& tested_kmers);
+void fitPatterns(PatternTable& patterns, const cmdOptions& parameters, const std::vector<AssocModel>& models);
+
@@ -7,31 +7,273 @@
 
 #include "seer.hpp"
 
-// Logistic fit without covariates
-void logisticTest(Kmer& k, const arma::vec& y_train, const double null_ll)
+// Logistic fit. x_design is the design matrix with the k-mer already in
+// column 1: intercept, k-mer, covariates
+void logisticTest(Kmer& k, const arma::vec& y_train, const NullModel& null_model, FitStats* fit_stats, const arma::mat& x_design)
 {
    // Train classifier
-   arma::mat x_train = arma::join_rows(arma::mat(y_train.n_rows,1,arma::fill::ones), k.get_x());
-   doLogit(k, y_train, x_train);
+   doLogit(k, y_train, x_design, null_model.beta, fit_stats);
 
    // Likelihood ratio test
-   k.lrt_p_val(likelihoodRatioTest(k, null_ll));
+   k.lrt_p_val(likelihoodRatioTest(k, null_model.log_likelihood));
 }
 
-// Logistic fit with covariates
-void logisticTest(Kmer& k, const arma::vec& y_train, const double null_ll, const arma::mat& mds)
+// Score (Rao) test of adding the k-mer to the null model. Needs only sums
+// over the samples the k-mer is present in, so is much cheaper than a fit
+// See: doi:10.1093/biomet/35.1-2.97
+void scoreTest(Kmer& k, const NullModel& null_model)
 {
-   // Train classifier
-   arma::mat x_train = arma::join_rows(arma::mat(y_train.n_rows,1,arma::fill::ones), k.get_x());
-   x_train = arma::join_rows(x_train, mds);
-   doLogit(k, y_train, x_train);
+   // U = x'(y - p)
+   // V = x'Wx - x'WX (X'WX)^-1 X'Wx
+   double U = 0, xWx = 0;
+   arma::vec XWx = arma::zeros(null_model.weighted_design_t.n_rows);
+   k.presence().for_each_set([&](const size_t i)
+   {
+      U += null_model.residuals[i];
+      xWx += null_model.weights[i];
+      XWx += null_model.weighted_design_t.col(i);
+   });
+
+   double V = xWx - arma::as_scalar(XWx.t() * null_model.inv_information * XWx);
+
+   // One step estimate of beta from the null
+   k.beta(U / V);
+   k.standard_error(pow(V, -0.5));
+
+   double S = std::abs(U) * pow(V, -0.5); // ~ N(0,1)
+   k.p_val(normalPval(S));
+   k.lrt_p_val(k.p_val());
+
+   // Covariate effects are not estimated
+   for (unsigned int i = 1; i < null_model.beta.n_elem; ++i)
+   {
+      k.add_covar_p(std::numeric_limits<double>::quiet_NaN());
+   }
+}
+
+// Newton-Raphson fits of many k-mers at once, starting from the null model.
+// Returns the k-mers which still need fitting on their own: those flagged for
+// Firth regression, and any which fail to converge, fail inversion or have a
+// large SE
+std::vector<Kmer*> logisticBatch(const std::vector<Kmer*>& kmers, const arma::vec& y_train, const NullModel& null_model, FitStats* fit_stats)
+{
+   std::vector<Kmer*> unfitted;
+   std::vector<Kmer*> to_fit;
+   for (auto it = kmers.begin(); it != kmers.end(); ++it)
+   {
+      if ((*it)->firth())
+      {
+         unfitted.push_back(*it);
+      }
+      else
+      {
+         to_fit.push_back(*it);
+      }
+   }
+
+   for (size_t start = 0; start < to_fit.size(); start += logit_block_size)
+   {
+      const size_t end = std::min(start + logit_block_size, to_fit.size());
+      std::vector<Kmer*> block(to_fit.begin() + start, to_fit.begin() + end);
+      logisticBlock(block, y_train, null_model, fit_stats, unfitted);
+   }
+
+   return unfitted;
+}
+
+// Advances a block of k-mers through Newton-Raphson iterations together.
+// Each k-mer is a column of the working matrices, so the predictions, scores
+// and information matrices of the whole block are matrix products. Columns
+// are dropped from the block as their fits converge
+//
+// The information matrix of each fit is built from blocks:
+//    [ X'WX  X'Wx ]
+//    [ x'WX  x'Wx ]
+// in the order of the full design matrix: intercept, k-mer, covariates
+void logisticBlock(const std::vector<Kmer*>& block, const arma::vec& y_train, const NullModel& null_model, FitStats* fit_stats, std::vector<Kmer*>& unfitted)
+{
+   const arma::mat& X = null_model.design;
+   const unsigned int num_covar = X.n_cols;
+
+   // Position of each null model coefficient in the full design
+   arma::uvec full_index(num_covar);
+   for (unsigned int i = 0; i < num_covar; ++i)
+   {
+      full_index(i) = i == 0 ? 0 : i + 1;
+   }
+
+   std::vector<Kmer*> active = block;
+   arma::mat x_block = presenceMatrix(active, X.n_rows);
+   arma::mat b_covar = repmat(null_model.beta, 1, active.size());
+   arma::rowvec b_kmer = arma::zeros<arma::rowvec>(active.size());
+
+   for (unsigned int iter = 0; iter < max_batch_iterations && !active.empty(); ++iter)
+   {
+      arma::mat y_pred = X * b_covar + (x_block.each_row() % b_kmer);
+      y_pred = 1.0 / (1.0 + arma::exp(-y_pred));
+
+      const arma::mat W = y_pred % (1 - y_pred);
+      const arma::mat Wx = W % x_block;
+
+      arma::mat resid = -y_pred;
+      resid.each_col() += y_train;
+
+      const arma::mat U_covar = X.t() * resid;
+      const arma::rowvec U_kmer = sum(x_block % resid);
+      const arma::mat I_covar = null_model.design_products.t() * W;
+      const arma::mat I_cross = X.t() * Wx;
+      const arma::rowvec I_kmer = sum(Wx);
+
+      std::vector<arma::uword> keep;
+      for (size_t j = 0; j < active.size(); ++j)
+      {
+         arma::vec U(num_covar + 1);
+         U(1) = U_kmer(j);
+         U.elem(full_index) = U_covar.col(j);
+
+         // Perform inversion, which may fail
+         arma::mat var_covar_mat = inv_covar(blockInformation(I_covar.col(j), I_cross.col(j), I_kmer(j), full_index));
+         if (var_covar_mat.n_elem == 0)
+         {
+            unfitted.push_back(active[j]);
+            continue;
+         }
+
+         arma::vec step = var_covar_mat * U;
+         b_kmer(j) += step(1);
+         b_covar.col(j) += step.elem(full_index);
+
+         // Converged once every coefficient has stopped moving, as for the
+         // null model
+         if (max(abs(step)) < convergence_limit)
+         {
+            arma::vec b(num_covar + 1);
+            b(1) = b_kmer(j);
+            b.elem(full_index) = b_covar.col(j);
+
+            // The SE is from the information at the converged beta, rather
+            // than at the last iterate
+            const arma::vec linear_pred = X * b_covar.col(j) + x_block.col(j) * b_kmer(j);
+            const arma::vec y_fit = 1.0 / (1.0 + arma::exp(-linear_pred));
+            const arma::vec w = y_fit % (1 - y_fit);
+            var_covar_mat = inv_covar(blockInformation(null_model.design_products.t() * w, X.t() * (w % x_block.col(j)),
+                     dot(w, x_block.col(j)), full_index));
+
+            if (var_covar_mat.n_elem == 0 || !logisticResult(*active[j], b, var_covar_mat, linear_pred, y_train, null_model.log_likelihood))
+            {
+               unfitted.push_back(active[j]);
+            }
+            else if (fit_stats != NULL)
+            {
+               fit_stats->batch_fits++;
+               fit_stats->batch_iterations += iter + 1;
+            }
+         }
+         else
+         {
+            keep.push_back(j);
+         }
+      }
+
+      if (keep.size() < active.size())
+      {
+         std::vector<Kmer*> still_active;
+         still_active.reserve(keep.size());
+         for (auto it = keep.begin(); it != keep.end(); ++it)
+         {
+            still_active.push_back(active[*it]);
+         }
+         active.swap(still_active);
+
+         const arma::uvec keep_cols = arma::conv_to<arma::uvec>::from(keep);
+         x_block = x_block.cols(keep_cols);
+         b_covar = b_covar.cols(keep_cols);
+         b_kmer = b_kmer.cols(keep_cols);
+      }
+   }
+
+   // Not converged
+   unfitted.insert(unfitted.end(), active.begin(), active.end());
+}
+
+// Assembles the information matrix of one fit from its blocks: I_covar
+// holds the upper triangle of X'WX in the order of design_products, I_cross
+// is X'Wx and I_kmer is x'Wx
+arma::mat blockInformation(const arma::vec& I_covar, const arma::vec& I_cross, const double I_kmer, const arma::uvec& full_index)
+{
+   const unsigned int num_covar = full_index.n_elem;
+   arma::mat I(num_covar + 1, num_covar + 1);
+
+   I(1,1) = I_kmer;
+   unsigned int pair = 0;
+   for (unsigned int a = 0; a < num_covar; ++a)
+   {
+      I(full_index(a),1) = I(1,full_index(a)) = I_cross(a);
+      for (unsigned int b = a; b < num_covar; ++b)
+      {
+         I(full_index(a),full_index(b)) = I(full_index(b),full_index(a)) = I_covar(pair++);
+      }
+   }
+
+   return I;
+}
+
+// Sets the fit of a k-mer from converged batch Newton-Raphson, given its
+// coefficients b and linear predictor Xb. Returns 0, leaving the k-mer
+// untouched, if the SE is too large to trust
+int logisticResult(Kmer& k, const arma::vec& b, const arma::mat& var_covar_mat, const arma::vec& linear_pred, const arma::vec& y_train, const double null_ll)
+{
+   double se = pow(var_covar_mat(1,1), 0.5);
+   if (se > se_limit)
+   {
+      return 0;
+   }
+
+   // Log-likelihood at the converged beta
+   const arma::vec y_pred = 1.0 / (1.0 + arma::exp(-linear_pred));
+   double log_likelihood = 0;
+   for (size_t i = 0; i < y_train.n_elem; ++i)
+   {
+      if (y_train[i] == 1)
+      {
+         log_likelihood += log(y_pred[i]);
+      }
+      else
+      {
+         log_likelihood += log(1.0 - y_pred[i]);
+      }
+   }
+   k.log_likelihood(log_likelihood);
+
+   k.beta(b(1));
+   k.standard_error(se);
+
+   double W = std::abs(b(1)) / se;
+   k.p_val(normalPval(W));
+
+#ifdef SEER_DEBUG
+   std::cerr << "Wald statistic: " << W << "\n";
+   std::cerr << "p-value: " << k.p_val() << "\n";
+#endif
+   // Add in covariate p-values
+   for (unsigned int i = 2; i < var_covar_mat.n_rows; ++i)
+   {
+      se = pow(var_covar_mat(i,i), 0.5);
+      W = std::abs(b(i)) / se;
+
+      k.add_covar_p(normalPval(W));
+   }
 
    // Likelihood ratio test
    k.lrt_p_val(likelihoodRatioTest(k, null_ll));
+
+   return 1;
 }
 
 // This uses BFGS optimisation by default. Invokes NR or Firth on error
-void doLogit(Kmer& k, const arma::vec& y_train, const arma::mat& x_design)
+// If given, the null model coefficients are the starting point for the
+// intercept and covariates
+void doLogit(Kmer& k, const arma::vec& y_train, const arma::mat& x_design, const arma::vec& null_beta, FitStats* fit_stats)
 {
    column_vector starting_point(x_design.n_cols);
 
@@ -41,28 +283,47 @@ void doLogit(Kmer& k, const arma::vec& y_train, const arma::mat& x_design)
    }
    else
    {
-      starting_point(0) = log(mean(y_train)/(1 - mean(y_train)));
-      for (size_t i = 1; i < x_design.n_cols; ++i)
+      if (null_beta.n_elem + 1 == x_design.n_cols)
       {
-         starting_point(i) = bfgs_start_beta;
+         starting_point(0) = null_beta(0);
+         starting_point(1) = bfgs_start_beta;
+         for (size_t i = 2; i < x_design.n_cols; ++i)
+         {
+            starting_point(i) = null_beta(i - 1);
+         }
+      }
+      else
+      {
+         starting_point(0) = log(mean(y_train)/(1 - mean(y_train)));
+         for (size_t i = 1; i < x_design.n_cols; ++i)
+         {
+            starting_point(i) = bfgs_start_beta;
+         }
       }
 
       try
       {
          // Use BFGS optimiser in dlib to maximise likelihood function by chaging the
          // b vector, which will end in starting_point
-         LogitLikelihood likelihood_fit(x_design, y_train); // store this, as it is used for computing the LRT
+         LogitObjective likelihood_fit(x_design, y_train); // store this, as it is used for computing the LRT
 
+         unsigned long iterations = 0;
          dlib::find_max(dlib::bfgs_search_strategy(),
-                     dlib::objective_delta_stop_strategy(convergence_limit),
-                     likelihood_fit, LogitLikelihoodGradient(x_design, y_train),
+                     CountingStopStrategy(convergence_limit, iterations),
+                     LogitObjectiveLikelihood(likelihood_fit), LogitObjectiveGradient(likelihood_fit),
                      starting_point, -1);
 
+         if (fit_stats != NULL)
+         {
+            fit_stats->bfgs_fits++;
+            fit_stats->bfgs_iterations += iterations;
+         }
+
          // Extract beta and likelihood
          arma::vec b_vector = dlib_to_arma(starting_point);
          k.beta(b_vector(1));
 
-         k.log_likelihood(likelihood_fit(starting_point));
+         k.log_likelihood(likelihood_fit.likelihood(starting_point));
 
          // Extract p-value
          //
@@ -149,10 +410,10 @@ void newtonRaphson(Kmer& k, const arma::vec& y_train, const arma::mat& x_design,
       arma::vec y_pred = predictLogitProbs(x_design, b0);
 
       arma::mat U(x_design.n_cols, 1);
-      arma::mat W = repmat(y_pred % (arma::ones(y_pred.n_rows) - y_pred), 1, x_design.n_cols);
+      arma::vec W = y_pred % (1 - y_pred);
 
       // Perform inversion, which may fail
-      var_covar_mat = inv_covar(x_design.t() * (W % x_design));
+      var_covar_mat = inv_covar(weightedGram(x_design, W));
       if (var_covar_mat.n_cols == 0 || var_covar_mat.n_rows == 0)
       {
          k.add_comment("inv-fail");
@@ -166,15 +427,13 @@ void newtonRaphson(Kmer& k, const arma::vec& y_train, const arma::mat& x_design,
       {
          // Firth logistic regression
          // See: DOI: 10.1002/sim.1047
-         // Hat matrix
-         // Note: W is diagonal so X.t() * W * X is still sympd
-         arma::mat H = (sqrt(W) % x_design) * var_covar_mat * (x_design.t() % sqrt(W).t());
-
-         arma::vec correction(y_train.n_rows);
-         correction.fill(0.5);
+         // Only the diagonal of the hat matrix W^1/2 X (X'WX)^-1 X' W^1/2 is
+         // needed, which is h_i = w_i x_i' (X'WX)^-1 x_i. This is O(np^2)
+         // rather than forming the n x n matrix
+         arma::vec h = W % arma::sum((x_design * var_covar_mat) % x_design, 1);
 
          // Penalised score
-         U = x_design.t() * (y_train - y_pred + diagvec(H) % (correction - y_pred));
+         U = x_design.t() * (y_train - y_pred + h % (0.5 - y_pred));
       }
       else
       {
@@ -271,22 +530,8 @@ arma::mat varCovarMat(const arma::mat& x, const arma::mat& b)
    arma::vec y_pred = predictLogitProbs(x, b);
    arma::vec y_trans = y_pred % (1 - y_pred);
 
-   // Fill elements of I, which are sums of element by element vector multiples
-   arma::mat I(b.n_elem, b.n_elem);
-   unsigned int j_max = I.n_rows;
-   for (unsigned int i = 0; i<I.n_cols; ++i)
-   {
-      for (unsigned int j = i; j < j_max; j++)
-      {
-         I(i,j) = accu(y_trans % x.col(i) % x.col(j));
-         if (i != j)
-         {
-            I(j,i) = I(i,j); // I is symmetric - only need to calculate upper triangle
-         }
-      }
-   }
-
-   return inv_covar(I);
+   // Inversion uses the Cholesky decomposition of I, which is symmetric
+   return inv_covar(weightedGram(x, y_trans));
 }
 
 // returns y = logit(bx)
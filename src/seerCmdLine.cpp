@@ -19,8 +19,10 @@ int parseCommandLine (int argc, char *argv[], po::variables_map& vm)
    //Required options
    po::options_description required("Required options");
    required.add_options()
-    ("kmers,k", po::value<std::string>()->required(), "dsm kmer output file")
-    ("pheno,p", po::value<std::string>()->required(), ".pheno metadata");
+    ("kmers,k", po::value<std::string>()->required(), "dsm kmer output file, or binary kmer file from dsm2bin")
+    ("pheno,p", po::value<std::string>(), ".pheno metadata")
+    ("pheno_list", po::value<std::string>(), "file listing .pheno files (with the same samples) to test in one pass, instead of --pheno")
+    ("output,o", po::value<std::string>()->default_value("seer"), "prefix for the output file of each phenotype with --pheno_list");
 
    // kmds options
    po::options_description covar("Covariate options");
@@ -33,7 +35,10 @@ int parseCommandLine (int argc, char *argv[], po::variables_map& vm)
    //NB pval cutoffs are strings for display, and are converted to floats later
    po::options_description performance("Performance options");
    performance.add_options()
-    ("threads", po::value<int>()->default_value(1), ("number of threads. Suggested: " + std::to_string(std::thread::hardware_concurrency())).c_str());
+    ("threads", po::value<int>()->default_value(1), ("number of threads. Suggested: " + std::to_string(std::thread::hardware_concurrency())).c_str())
+    ("cache_size", po::value<long int>()->default_value(cache_size_default), "number of k-mer presence patterns to reuse test results for. 0 to turn off")
+    ("dedup_patterns", "test each unique k-mer presence pattern once. Reads the k-mer file twice")
+    ("region", po::value<std::string>(), "only test k-mers in this range of a bgzipped k-mer file (start:end virtual offsets) or binary k-mer file (start:end byte offsets)");
 
    //Optional filtering parameters
    //NB pval cutoffs are strings for display, and are converted to floats later
@@ -44,11 +49,13 @@ int parseCommandLine (int argc, char *argv[], po::variables_map& vm)
     ("maf", po::value<double>()->default_value(maf_default), "minimum kmer frequency")
     ("min_words", po::value<int>(), "minimum kmer occurrences. Overrides --maf")
     ("chisq", po::value<std::string>()->default_value(chisq_default), "p-value threshold for initial chi squared test. Set to 1 to show all")
-    ("pval", po::value<std::string>()->default_value(pval_default), "p-value threshold for final logistic test. Set to 1 to show all");
+    ("pval", po::value<std::string>()->default_value(pval_default), "p-value threshold for final logistic test. Set to 1 to show all")
+    ("score_test", po::value<std::string>(), "p-value threshold for a score test before the logistic test (binary phenotypes only). Only k-mers below this are fitted, so set above --pval");
 
    po::options_description other("Other options");
    other.add_options()
     ("print_samples", "print lists of samples significant kmers were found in")
+    ("fit_stats", "print how many k-mers reused a cached result, which varies with --threads, and the mean iterations of each kind of fit")
     ("version", "prints version and exits")
     ("help,h", "full help message");
 
@@ -75,7 +82,14 @@ int parseCommandLine (int argc, char *argv[], po::variables_map& vm)
          failed = 0;
 
          // Check input files exist, and can stat
-         if (!fileStat(vm["kmers"].as<std::string>()) || !fileStat(vm["pheno"].as<std::string>()))
+         if (vm.count("pheno") == vm.count("pheno_list"))
+         {
+            std::cerr << "Exactly one of --pheno and --pheno_list must be given\n";
+            failed = 1;
+         }
+         else if (!fileStat(vm["kmers"].as<std::string>())
+               || (vm.count("pheno") && !fileStat(vm["pheno"].as<std::string>()))
+               || (vm.count("pheno_list") && !fileStat(vm["pheno_list"].as<std::string>())))
          {
             failed = 1;
          }
@@ -35,10 +35,24 @@ cmdOptions verifyCommandLine(boost::program_options::variables_map& vm, const st
       verified.log_cutoff = stod(vm["pval"].as<std::string>());
    }
 
+   verified.score_test = 0;
+   if (vm.count("score_test"))
+   {
+      verified.score_test = 1;
+      verified.score_cutoff = stod(vm["score_test"].as<std::string>());
+   }
+
    // Verify MDS options in a separate function
-   // This is pc, size and number of threads
+   // This is pc, size, seed and number of threads
    verifyMDSOptions(verified, vm);
 
+   verified.region_start = 0;
+   verified.region_end = bgzf_no_end;
+   if (vm.count("region"))
+   {
+      parseRegion(vm["region"].as<std::string>(), verified.region_start, verified.region_end);
+   }
+
    verified.filter = 1;
    if (vm.count("no_filtering"))
    {
@@ -80,12 +94,37 @@ cmdOptions verifyCommandLine(boost::program_options::variables_map& vm, const st
       verified.max_words = samples.size() - verified.min_words;
    }
 
+   verified.cache_size = 0;
+   if (vm.count("cache_size"))
+   {
+      if (vm["cache_size"].as<long int>() >= 0)
+      {
+         verified.cache_size = vm["cache_size"].as<long int>();
+      }
+      else
+      {
+         badCommand("cache_size", std::to_string(vm["cache_size"].as<long int>()));
+      }
+   }
+
+   verified.dedup_patterns = 0;
+   if (vm.count("dedup_patterns"))
+   {
+      verified.dedup_patterns = 1;
+   }
+
    verified.print_samples = 0;
    if (vm.count("print_samples"))
    {
       verified.print_samples = 1;
    }
 
+   verified.fit_stats = 0;
+   if (vm.count("fit_stats"))
+   {
+      verified.fit_stats = 1;
+   }
+
    return verified;
 }
 
@@ -127,6 +166,12 @@ void verifyMDSOptions(cmdOptions& verified, boost::program_options::variables_ma
       }
    }
 
+   verified.seed = 0;
+   if (vm.count("seed"))
+   {
+      verified.seed = vm["seed"].as<unsigned int>();
+   }
+
    if (vm.count("write_distances"))
    {
       verified.write_distances = 1;
@@ -137,6 +182,38 @@ void verifyMDSOptions(cmdOptions& verified, boost::program_options::variables_ma
    }
 }
 
+// Region of a BGZF file as start:end virtual offsets. Either may be left
+// out to read from the start or to the end
+void parseRegion(const std::string& region, uint64_t& start, uint64_t& end)
+{
+   size_t separator = region.find(':');
+   if (separator == std::string::npos)
+   {
+      badCommand("region", region);
+   }
+
+   try
+   {
+      if (separator > 0)
+      {
+         start = std::stoull(region.substr(0, separator));
+      }
+      if (separator + 1 < region.size())
+      {
+         end = std::stoull(region.substr(separator + 1));
+      }
+   }
+   catch (std::exception& e)
+   {
+      badCommand("region", region);
+   }
+
+   if (end < start)
+   {
+      badCommand("region", region);
+   }
+}
+
 // Check for continuous phenotype. If even one sample has neither 0 or 1 as
 // phenotype
 int continuousPhenotype (const std::vector<Sample>& sample_list)
@@ -216,8 +293,7 @@ void normaliseMatCols(arma::mat& matrix_in)
 }
 
 // Inverts a symmetric positive matrix, checking for errors
-// Not passed by ref, creates a copy. Right thing to do?
-arma::mat inv_covar(arma::mat A)
+arma::mat inv_covar(const arma::mat& A)
 {
    // Try the default. Internally this uses Cholesky decomposition and back
    // solves. For large condition numbers it fails.
@@ -237,3 +313,13 @@ arma::mat inv_covar(arma::mat A)
    return B;
 }
 
+
+// X'diag(w)X for non-negative weights w, such as the Fisher information of
+// a logistic fit. Scaling the rows of X by sqrt(w) makes this a product of a
+// matrix with its own transpose, which armadillo computes with a single
+// symmetric rank-k update (syrk)
+arma::mat weightedGram(const arma::mat& x, const arma::vec& w)
+{
+   const arma::mat x_scaled = x.each_col() % arma::sqrt(w);
+   return x_scaled.t() * x_scaled;
+}
@@ -7,27 +7,120 @@
 
 #include "seer.hpp"
 
-// Linear fit without covariates
-void linearTest(Kmer& k, const arma::vec& y_train, const double null_ll)
+// Linear fit. x_design is the design matrix with the k-mer already in
+// column 1: intercept, k-mer, covariates
+void linearTest(Kmer& k, const arma::vec& y_train, const NullModel& null_model, const arma::mat& x_design)
 {
-   // Train classifier
-   arma::mat x_train = join_rows(arma::mat(y_train.n_rows,1,arma::fill::ones), k.get_x());
-   doLinear(k, y_train, x_train);
+   if (null_model.q_t.n_elem > 0)
+   {
+      projectedLinear(k, null_model);
+   }
+   else
+   {
+      // Train classifier
+      doLinear(k, y_train, x_design);
+   }
 
    // Likelihood ratio test
    k.lrt_p_val(k.p_val());
 }
 
-// Linear fit with covariates
-void linearTest(Kmer& k, const arma::vec& y_train, const double null_ll, const arma::mat& mds)
+// Closed form least squares for the k-mer, given the null fit on the
+// intercept and covariates X. By Frisch-Waugh-Lovell, beta is the regression
+// of the null residuals on the k-mer with X projected out: rx = x - QQ'x
+// See: doi:10.2307/1907330
+//
+// As x is 0/1, Q'x and x'(y - Xb) are sums over the samples the k-mer is
+// present in, and as the residuals are orthogonal to Q, rx'rx = x'x - |Q'x|^2
+void projectedLinear(Kmer& k, const NullModel& null_model)
 {
-   // Train classifier
-   arma::mat x_train = join_rows(arma::mat(y_train.n_rows,1,arma::fill::ones), k.get_x());
-   x_train = join_rows(x_train, mds);
-   doLinear(k, y_train, x_train);
+   arma::vec qx = arma::zeros(null_model.q_t.n_rows);
+   double x_resid = 0;
+   k.presence().for_each_set([&](const size_t i)
+   {
+      qx += null_model.q_t.col(i);
+      x_resid += null_model.residuals[i];
+   });
 
-   // Likelihood ratio test
-   k.lrt_p_val(k.p_val());
+   const double sxx = k.num_occurrences() - dot(qx, qx);
+   projectedResult(k, sxx, x_resid, null_model.r_inv * qx, null_model);
+}
+
+// As projectedLinear, but for a block of k-mers at once. The covariates have
+// already been projected out of the presence of the k-mers, together, for
+// every continuous phenotype (see projectBatch), leaving only x'(y - Xb) to
+// find here. positions are those of the k-mers in the projected batch
+void linearBatch(const std::vector<Kmer*>& kmers, const std::vector<size_t>& positions, const ProjectedBatch& projected, const NullModel& null_model)
+{
+   if (kmers.empty())
+   {
+      return;
+   }
+
+   const arma::rowvec x_resid = null_model.residuals.t() * projected.x_block;
+
+   for (size_t j = 0; j < kmers.size(); ++j)
+   {
+      const long int column = projected.columns[positions[j]];
+      projectedResult(*kmers[j], projected.sxx(column), x_resid(column), projected.g.col(column), null_model);
+      kmers[j]->lrt_p_val(kmers[j]->p_val());
+   }
+}
+
+// Sets the fit of a k-mer from its projected sums: sxx = rx'rx,
+// x_resid = x'(y - Xb), and g = R^-1 Q'x
+void projectedResult(Kmer& k, const double sxx, const double x_resid, const arma::vec& g, const NullModel& null_model)
+{
+   if (sxx < convergence_limit)
+   {
+      // k-mer is explained entirely by the covariates
+      k.add_comment("collinear");
+      k.p_val(1);
+
+      // No fit, but the output still has a column for each covariate
+      for (unsigned int i = 1; i < null_model.beta.n_elem; ++i)
+      {
+         k.add_covar_p(std::numeric_limits<double>::quiet_NaN());
+      }
+      return;
+   }
+
+   const double b = x_resid / sxx;
+   k.beta(b);
+
+   // Extract p-values
+   const double SSE = null_model.log_likelihood - b * b * sxx;
+   const double MSE = SSE / (null_model.residuals.n_elem - 2);
+
+   // For LRT test
+   k.log_likelihood(SSE);
+
+   // Wald test
+   // W = B_1 / SE(B_1) ~ N(0,1)
+   //
+   // SE(B_1) = MSE * (rx'rx)^-1
+   //
+   double se = pow(MSE / sxx, 0.5);
+   k.standard_error(se);
+
+   double W = std::abs(b) / se; // null hypothesis b_1 = 0
+   k.p_val(normalPval(W));
+
+#ifdef SEER_DEBUG
+   std::cerr << "Wald statistic: " << W << "\n";
+   std::cerr << "p-value: " << k.p_val() << "\n";
+#endif
+
+   // Add in covariate p-values. Adding the k-mer changes the covariate
+   // coefficients to b0 - g*b, and their variances to (X'X)^-1 + gg'/rx'rx
+   for (unsigned int i = 1; i < null_model.beta.n_elem; ++i)
+   {
+      double covar_b = null_model.beta(i) - g(i) * b;
+      se = pow(MSE * (null_model.inv_information(i,i) + g(i) * g(i) / sxx), 0.5);
+      W = std::abs(covar_b) / se;
+
+      k.add_covar_p(normalPval(W));
+   }
 }
 
 // Run linear fit
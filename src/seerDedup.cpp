@@ -0,0 +1,133 @@
+/*
+ * File: seerDedup.cpp
+ *
+ * Two pass mode for seer (--dedup_patterns). The first pass finds the unique
+ * presence patterns of k-mers passing filters, which are each tested once.
+ * The second pass writes every k-mer with the result for its pattern
+ *
+ */
+
+#include "seer.hpp"
+
+void dedupAssoc(const cmdOptions& parameters, const std::vector<AssocModel>& models,
+      long int& input_line, long int& tested_kmers, long int& significant_kmers)
+{
+   // Only a single phenotype
+   const AssocModel& model = models[0];
+
+   PatternTable patterns;
+
+   // First pass
+   {
+      DsmReader first_pass(parameters.kmers, parameters.num_threads, parameters.region_start, parameters.region_end);
+      collectPatterns(first_pass, parameters, model, patterns, input_line, tested_kmers);
+   }
+
+   std::cerr << "Found " << patterns.index.size() << " unique presence patterns in "
+      << tested_kmers << " k-mers to be tested\n";
+
+   fitPatterns(patterns, parameters, models);
+
+   // Second pass. Filters are applied again to find the k-mers which were
+   // tested, which is cheap compared to the regressions. Everything in the
+   // result, including the chisq p-value and comments, depends only on the
+   // presence pattern, so is taken from the pattern's test
+   DsmReader second_pass(parameters.kmers, parameters.num_threads, parameters.region_start, parameters.region_end);
+
+   Kmer k;
+   while (second_pass.next_line())
+   {
+      second_pass.parse(k, model.samples);
+      if (passFilters(parameters, k, model))
+      {
+         auto pattern_it = patterns.index.find(k.presence());
+         if (pattern_it == patterns.index.end())
+         {
+            throw std::runtime_error("k-mer " + k.sequence() + " not seen in first pass. Has " + parameters.kmers + " changed?");
+         }
+
+         applyResult(patterns.results[pattern_it->second], k);
+         significant_kmers += printKmer(std::cout, k, parameters, model.samples);
+      }
+   }
+}
+
+// Read through the k-mer file, keeping each new presence pattern of k-mers
+// which pass filters
+void collectPatterns(DsmReader& kmer_file, const cmdOptions& parameters, const AssocModel& model,
+      PatternTable& patterns, long int& input_line, long int& tested_kmers)
+{
+   Kmer k;
+   while (kmer_file.next_line())
+   {
+      kmer_file.parse(k, model.samples);
+      ++input_line;
+
+      if (passFilters(parameters, k, model))
+      {
+         patterns.index.emplace(k.presence(), patterns.index.size());
+         tested_kmers++;
+      }
+   }
+}
+
+// Test each pattern once, using the thread pool. A pattern is tested as a
+// k-mer with no sequence, numbered by its position in the table. Patterns
+// passed the stats filters in the first pass, so pass them again in the pool
+void fitPatterns(PatternTable& patterns, const cmdOptions& parameters, const std::vector<AssocModel>& models)
+{
+   patterns.results.resize(patterns.index.size());
+
+   const size_t max_in_flight = queue_depth * parameters.num_threads;
+   BoundedQueue<KmerBatch> kmer_queue(max_in_flight);
+   ReorderBuffer<KmerBatch> results(max_in_flight);
+
+   std::vector<std::thread> workers;
+   workers.reserve(parameters.num_threads);
+   for (unsigned int i = 0; i < parameters.num_threads; ++i)
+   {
+      workers.push_back(std::thread(assocWorker, std::ref(kmer_queue), std::ref(results), std::cref(parameters), std::cref(models)));
+   }
+
+   // Store results as they finish
+   std::thread collector([&patterns, &results]()
+   {
+      KmerBatch fitted;
+      while (results.pop(fitted))
+      {
+         for (auto it = fitted.tested[0].begin(); it != fitted.tested[0].end(); ++it)
+         {
+            patterns.results[it->line_number()] = storeResult(*it);
+         }
+      }
+   });
+
+   KmerBatch batch;
+   batch.batch_nr = 0;
+   batch.kmers.reserve(batch_size);
+   for (auto pattern_it = patterns.index.begin(); pattern_it != patterns.index.end(); ++pattern_it)
+   {
+      Kmer k;
+      k.add_x(pattern_it->first);
+      k.set_line_nr(pattern_it->second);
+
+      batch.kmers.push_back(k);
+      if (batch.kmers.size() == batch_size)
+      {
+         sendBatch(batch, kmer_queue, results);
+      }
+   }
+
+   if (!batch.kmers.empty())
+   {
+      sendBatch(batch, kmer_queue, results);
+   }
+
+   kmer_queue.close();
+   for (auto it = workers.begin(); it != workers.end(); ++it)
+   {
+      it->join();
+   }
+   results.close();
+   collector.join();
+}
@@ -11,8 +11,9 @@
  */
 #include "seercommon.hpp"
 
-std::regex gzipped(".+\\.gz"); // matches .gz at the end of a string (as regex match
-                               // matches a whole string)
+#include <cstring>
+
+const unsigned char gzip_magic[] = {0x1f, 0x8b};
 std::regex covar_regex("^(\\d+)$");
 std::regex q_covar_regex("^(\\d+)q$");
 
@@ -20,7 +21,7 @@ std::regex q_covar_regex("^(\\d+)q$");
  * space separated:
  * FID, IID, phenotype (1 control, 2 case)
  */
-void readPheno(const std::string& filename, std::vector<Sample>& samples, std::unordered_map<std::string,int>& sample_map)
+void readPheno(const std::string& filename, std::vector<Sample>& samples)
 {
    std::ifstream ist(filename.c_str());
 
@@ -37,21 +38,68 @@ void readPheno(const std::string& filename, std::vector<Sample>& samples, std::u
 
    }
 
-   // Always keep samples sorted, for consistency between programs
+   // Always keep samples sorted, for consistency between programs. The
+   // index of each sample is then its position in the SampleIndex
    std::sort(samples.begin(), samples.end(), Sample::compareSamples);
+}
+
+// List of .pheno files, one per line, to test in a single pass
+std::vector<std::string> readPhenoList(const std::string& filename)
+{
+   std::ifstream ist(filename.c_str());
+   if (!ist)
+   {
+      throw std::runtime_error("Could not open pheno list file " + filename + "\n");
+   }
+
+   std::vector<std::string> pheno_files;
+   std::string pheno_file;
+   while (ist >> pheno_file)
+   {
+      pheno_files.push_back(pheno_file);
+   }
+
+   if (pheno_files.empty())
+   {
+      throw std::runtime_error("No pheno files listed in " + filename + "\n");
+   }
+
+   return pheno_files;
+}
+
+// Whether two (sorted) sample lists have the same names. Phenotypes may
+// differ
+int sameSamples(const std::vector<Sample>& samples_1, const std::vector<Sample>& samples_2)
+{
+   int same = samples_1.size() == samples_2.size();
+   for (size_t i = 0; same && i < samples_1.size(); ++i)
+   {
+      same = samples_1[i].iid() == samples_2[i].iid();
+   }
+
+   return same;
+}
 
-   // Map of sample names to index in vector
-   for (unsigned int sample_index = 0; sample_index < samples.size(); ++sample_index)
+// Name of a phenotype for output files: its pheno file name, without any
+// directory or extension
+std::string phenotypeName(const std::string& pheno_file)
+{
+   std::string name = pheno_file.substr(pheno_file.find_last_of('/') + 1);
+
+   const size_t extension = name.find_last_of('.');
+   if (extension != std::string::npos && extension > 0)
    {
-      sample_map[samples[sample_index].iid()] = sample_index;
+      name = name.substr(0, extension);
    }
+
+   return name;
 }
 
 // Open dsm files, which are possibly zipped
 void openDsmFile(igzstream& dsm_stream, const std::string& file_name)
 {
-   // Check for a .gz extension
-   if (!std::regex_match(file_name, gzipped))
+   // Check for gzip compression. Pipes are not looked at
+   if (regularFile(file_name) && !gzippedFile(file_name))
    {
       // Warn
       std::cerr << "WARNING: Input file " + file_name
@@ -68,6 +116,31 @@ void openDsmFile(igzstream& dsm_stream, const std::string& file_name)
 
 }
 
+// Whether a file starts with the gzip magic bytes, which BGZF files also do.
+// Only regular files are read, so nothing is taken from a pipe
+int gzippedFile(const std::string& file_name)
+{
+   int gzipped = 0;
+   if (regularFile(file_name))
+   {
+      std::ifstream file(file_name.c_str(), std::ios::in | std::ios::binary);
+
+      unsigned char magic[sizeof(gzip_magic)];
+      file.read(reinterpret_cast<char*>(magic), sizeof(magic));
+
+      gzipped = file.gcount() == sizeof(magic) && memcmp(magic, gzip_magic, sizeof(magic)) == 0;
+   }
+
+   return gzipped;
+}
+
+// Whether a file exists and is a regular file, rather than a pipe or device
+int regularFile(const std::string& file_name)
+{
+   struct stat file_info;
+   return stat(file_name.c_str(), &file_info) == 0 && S_ISREG(file_info.st_mode);
+}
+
 arma::vec constructVecY(const std::vector<Sample>& samples)
 {
    arma::vec y;
@@ -81,6 +154,21 @@ arma::vec constructVecY(const std::vector<Sample>& samples)
    return y;
 }
 
+// Packed version of a binary phenotype: bit set for cases
+BitVector constructCaseMask(const arma::vec& y)
+{
+   BitVector cases(y.n_elem);
+   for (unsigned int i = 0; i < y.n_elem; ++i)
+   {
+      if (y[i] != 0)
+      {
+         cases.set(i);
+      }
+   }
+
+   return cases;
+}
+
 // Also saves sample information
 void writeMDS(const std::string& file_name, const std::vector<Sample>& sample_names, const arma::mat& MDS)
 {
@@ -26,21 +26,28 @@ int main (int argc, char *argv[])
       return 1;
    }
 
-   // Open .pheno file, parse into vector of samples
-   std::vector<Sample> samples;
-   std::unordered_map<std::string,int> sample_map;
-
-   if (vm.count("pheno"))
+   // Open .pheno files, parse into vectors of samples. With --pheno_list
+   // every phenotype is tested in the same pass through the k-mers
+   std::vector<std::string> pheno_files;
+   if (vm.count("pheno_list"))
    {
-      readPheno(vm["pheno"].as<std::string>(), samples, sample_map);
+      pheno_files = readPhenoList(vm["pheno_list"].as<std::string>());
    }
    else
    {
-      throw std::runtime_error("--pheno option is compulsory");
+      pheno_files.push_back(vm["pheno"].as<std::string>());
    }
 
-   arma::vec y = constructVecY(samples);
-   int continuous_phenotype = continuousPhenotype(samples);
+   std::vector<std::vector<Sample>> phenotypes(pheno_files.size());
+   for (size_t p = 0; p < pheno_files.size(); ++p)
+   {
+      readPheno(pheno_files[p], phenotypes[p]);
+      if (!sameSamples(phenotypes[0], phenotypes[p]))
+      {
+         throw std::runtime_error("Samples in " + pheno_files[p] + " are not the same as in " + pheno_files[0]);
+      }
+   }
+   const std::vector<Sample>& samples = phenotypes[0];
 
    // Get mds values
    arma::mat mds;
@@ -87,167 +94,137 @@ int main (int argc, char *argv[])
       }
    }
 
-   // Disambiguate overloaded logistic functions by the type of parameter they
-   // take
-   void (*mdsLogitFunc)(Kmer&, const arma::vec&, const double, const arma::mat&) = &logisticTest;
-   void (*logitFunc)(Kmer&, const arma::vec&, const double) = &logisticTest;
-
-   void (*mdsLinearFunc)(Kmer&, const arma::vec&, const double, const arma::mat&) = &linearTest;
-   void (*linearFunc)(Kmer&, const arma::vec&, const double) = &linearTest;
-
    // Error check command line options
    cmdOptions parameters = verifyCommandLine(vm, samples);
+   if (parameters.dedup_patterns && pheno_files.size() > 1)
+   {
+      throw std::runtime_error("--dedup_patterns can only be used with a single phenotype");
+   }
 
-   // calculate the null log-likelihood
-   Kmer null_kmer;
-   arma::mat x(y.n_rows, 1, arma::fill::ones);
+   // Design matrix for the null models, which is the same for every
+   // phenotype
+   arma::mat x(samples.size(), 1, arma::fill::ones);
    if (use_mds)
    {
       x = join_rows(x, mds);
    }
 
-   double null_ll = nullLogLikelihood(x, y, continuous_phenotype);
-
-   // Open the dsm kmer ifstream, and read through the whole thing
-   igzstream kmer_file;
-   openDsmFile(kmer_file, parameters.kmers);
-
-   // Write a header
-   std::string header = "sequence\tmaf\tchisq_p_val\twald_p_val\tlrt_p_val\tbeta\tse";
-   if (use_mds)
+   // Fixed data needed by all tests, for each phenotype
+   FitStats fit_stats;
+   std::vector<AssocModel> models(pheno_files.size());
+   std::vector<std::unique_ptr<ResultCache>> caches;
+   for (size_t p = 0; p < pheno_files.size(); ++p)
    {
-      std::cout << header;
-      for (unsigned int i = 1; i <= mds.n_cols; ++i)
+      AssocModel& model = models[p];
+      model.y = constructVecY(phenotypes[p]);
+      model.samples = SampleIndex(samples);
+      model.continuous = continuousPhenotype(phenotypes[p]);
+      if (!model.continuous)
       {
-         std::cout << "\tcovar" << i << "_p";
+         model.cases = constructCaseMask(model.y);
       }
-      std::cout << "\tcomments";
-   }
-   else
-   {
-      std::cout << header << "\tcomments";
-   }
-   if (parameters.print_samples)
-   {
-      std::cout << "\tsamples_present";
-   }
-   std::cout << std::endl;
+      model.mds = mds;
+      model.use_mds = use_mds;
 
-   long int input_line = 0;
-   long int tested_kmers = 0;
-   long int significant_kmers = 0;
-   while (kmer_file)
-   {
-      // Parse a set of dsm lines
-      std::vector<Kmer> kmer_lines;
-      kmer_lines.reserve(parameters.num_threads);
+      // calculate the null log-likelihood
+      model.null_ll = nullLogLikelihood(x, model.y, model.continuous, model.null_model);
 
-      Kmer k;
-      while(kmer_lines.size() < parameters.num_threads && kmer_file)
+      model.score_test = parameters.score_test && !model.continuous;
+      model.score_cutoff = parameters.score_cutoff;
+      if (model.score_test && model.null_model.beta.n_elem == 0)
       {
-         kmer_file >> k;
-         k.set_line_nr(++input_line);
-
-         if (kmer_file)
-         {
-            k.add_x(sample_map, samples.size());
+         std::cerr << "WARNING: Null model for " << pheno_files[p] << " did not converge, so cannot use --score_test\n";
+         model.score_test = 0;
+      }
 
-            // apply filters here
-            if (!parameters.filter)
-            {
-               kmer_lines.push_back(k);
-               tested_kmers++;
-            }
-            else if (passBasicFilters(parameters, k) && passStatsFilters(parameters, k, y, continuous_phenotype))
-            {
-#ifdef SEER_DEBUG
-               std::cerr << "kmer " + k.sequence() + " seems significant\n";
-#endif
-               kmer_lines.push_back(k);
-               tested_kmers++;
-            }
-         }
+      // Patterns are already unique when deduplicating, so nothing to cache
+      caches.push_back(std::unique_ptr<ResultCache>(new ResultCache(parameters.cache_size)));
+      model.cache = NULL;
+      if (parameters.cache_size > 0 && !parameters.dedup_patterns)
+      {
+         model.cache = caches.back().get();
       }
 
-      // Thread from here...
-      std::vector<std::thread> threads;
-      threads.reserve(kmer_lines.size());
+      model.fit_stats = &fit_stats;
+   }
 
-      for (unsigned int i = 0; i<kmer_lines.size(); ++i)
+   // A single phenotype is written to stdout, otherwise each to its own file
+   std::vector<std::ostream*> outputs;
+   std::vector<std::unique_ptr<std::ofstream>> output_files;
+   if (pheno_files.size() == 1)
+   {
+      outputs.push_back(&std::cout);
+   }
+   else
+   {
+      for (size_t p = 0; p < pheno_files.size(); ++p)
       {
-         // Association test
-         // Note threads must be passed values as they are copied
-         // std::reference_wrapper allows references to be passed
-         if (use_mds)
+         const std::string output_file_name = parameters.output + "." + phenotypeName(pheno_files[p]) + ".txt";
+         for (size_t q = 0; q < p; ++q)
          {
-            if (continuous_phenotype)
+            if (phenotypeName(pheno_files[q]) == phenotypeName(pheno_files[p]))
             {
-               threads.push_back(std::thread(mdsLinearFunc, std::ref(kmer_lines[i]), std::cref(y), null_ll, std::cref(mds)));
-            }
-            else
-            {
-               threads.push_back(std::thread(mdsLogitFunc, std::ref(kmer_lines[i]), std::cref(y), null_ll, std::cref(mds)));
+               throw std::runtime_error("Pheno files " + pheno_files[q] + " and " + pheno_files[p] + " would both be written to " + output_file_name);
             }
          }
-         else
+
+         output_files.push_back(std::unique_ptr<std::ofstream>(new std::ofstream(output_file_name.c_str())));
+         if (!*output_files.back())
          {
-            if (continuous_phenotype)
-            {
-               threads.push_back(std::thread(linearFunc, std::ref(kmer_lines[i]), std::cref(y), null_ll));
-            }
-            else
-            {
-               threads.push_back(std::thread(logitFunc, std::ref(kmer_lines[i]), std::cref(y), null_ll));
-            }
+            throw std::runtime_error("Could not open output file " + output_file_name);
          }
+         outputs.push_back(output_files.back().get());
       }
+   }
 
-      for (unsigned int i = 0; i<threads.size(); ++i)
-      {
-         // Rejoin in order
-         threads[i].join();
-
-         // Print in order when all threads complete
-         if (!parameters.filter || kmer_lines[i].p_val() < parameters.log_cutoff || kmer_lines[i].lrt_p_val() < parameters.log_cutoff)
-         {
-            significant_kmers++;
-            // Caclculate chisq value if not already done so in filtering
-            if (kmer_lines[i].unadj() == kmer_chi_pvalue_default)
-            {
-               if (continuous_phenotype)
-               {
-                  kmer_lines[i].unadj_p_val(welchTwoSamplet(kmer_lines[i], y));
-               }
-               else
-               {
-                  kmer_lines[i].unadj_p_val(chiTest(kmer_lines[i], y));
-               }
-            }
+   for (size_t p = 0; p < models.size(); ++p)
+   {
+      writeHeader(*outputs[p], parameters, models[p]);
+   }
 
-            std::cout << kmer_lines[i];
-            if (parameters.print_samples)
-            {
-               std::vector<std::string> samples_found = kmer_lines[i].occurrence_vector();
-               std::cout << "\t";
-               // Doing this for all samples leaves trailing whitespace, so
-               // write the last sample separately
-               if (samples_found.size() > 1)
-               {
-                  std::copy(samples_found.begin(), samples_found.end() - 1, std::ostream_iterator<std::string>(std::cout, "\t"));
-               }
-               std::cout << samples_found.back();
-            }
-            std::cout << std::endl;
+   // Read through the k-mer file and test
+   long int input_line = 0;
+   std::vector<long int> tested_kmers(models.size(), 0);
+   std::vector<long int> significant_kmers(models.size(), 0);
+   if (parameters.dedup_patterns)
+   {
+      dedupAssoc(parameters, models, input_line, tested_kmers[0], significant_kmers[0]);
+   }
+   else
+   {
+      pipelineAssoc(parameters, models, outputs, input_line, tested_kmers, significant_kmers);
+   }
 
-         }
+   std::cerr << "Read " << input_line << " total k-mers. Of these:\n";
+   for (size_t p = 0; p < models.size(); ++p)
+   {
+      std::string indent = "\t";
+      if (models.size() > 1)
+      {
+         std::cerr << "\t" << phenotypeName(pheno_files[p]) << ":\n";
+         indent = "\t\t";
+      }
+      std::cerr << indent << "Pre-filtered " << input_line - tested_kmers[p] << " k-mers\n";
+      std::cerr << indent << "Tested " << tested_kmers[p] << " k-mers\n";
+      std::cerr << indent << "Printed " << significant_kmers[p] << " k-mers\n";
+      // Which k-mers hit the cache depends on the order batches finish in
+      if (parameters.fit_stats && models[p].cache != NULL)
+      {
+         std::cerr << indent << "Reused results for " << models[p].cache->hits() << " k-mers; tested the other "
+            << models[p].cache->misses() << "\n";
       }
-      // ...to here
    }
-
-   std::cerr << "Read " << input_line - 1 << " total k-mers. Of these:\n";
-   std::cerr << "\tPre-filtered " << input_line - tested_kmers - 1 << " k-mers\n";
-   std::cerr << "\tTested " << tested_kmers << " k-mers\n";
-   std::cerr << "\tPrinted " << significant_kmers << " k-mers\n";
+   // Iterations per fit, to show what starting from the null model saves
+   if (parameters.fit_stats && fit_stats.batch_fits > 0)
+   {
+      std::cerr << "\tFitted " << fit_stats.batch_fits << " k-mers by batch Newton-Raphson, mean "
+         << (double)fit_stats.batch_iterations / fit_stats.batch_fits << " iterations\n";
+   }
+   if (parameters.fit_stats && fit_stats.bfgs_fits > 0)
+   {
+      std::cerr << "\tFitted " << fit_stats.bfgs_fits << " k-mers by BFGS, mean "
+         << (double)fit_stats.bfgs_iterations / fit_stats.bfgs_fits << " iterations\n";
+   }
    std::cerr << "Done.\n";
 }
 
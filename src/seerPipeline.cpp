@@ -0,0 +1,423 @@
+/*
+ * File: seerPipeline.cpp
+ *
+ * Three stage pipeline for seer:
+ *    reader - decompresses and parses the dsm file, and applies basic filters
+ *    testers - a pool of threads running association tests on batches of
+ *       k-mers, against each phenotype
+ *    writer - prints tested k-mers in input order, one output per phenotype
+ *
+ */
+
+#include "seer.hpp"
+
+// Sets up and runs the pipeline. This thread reads k-mers, which are tested
+// against every phenotype by a pool of threads and written out by another
+void pipelineAssoc(const cmdOptions& parameters, const std::vector<AssocModel>& models, const std::vector<std::ostream*>& outputs,
+      long int& input_line, std::vector<long int>& tested_kmers, std::vector<long int>& significant_kmers)
+{
+   // Open the dsm kmer file, and read through the whole thing
+   DsmReader kmer_file(parameters.kmers, parameters.num_threads, parameters.region_start, parameters.region_end);
+
+   const size_t max_in_flight = queue_depth * parameters.num_threads;
+   BoundedQueue<KmerBatch> kmer_queue(max_in_flight);
+   ReorderBuffer<KmerBatch> results(max_in_flight);
+
+   std::vector<std::thread> workers;
+   workers.reserve(parameters.num_threads);
+   for (unsigned int i = 0; i < parameters.num_threads; ++i)
+   {
+      workers.push_back(std::thread(assocWorker, std::ref(kmer_queue), std::ref(results), std::cref(parameters), std::cref(models)));
+   }
+
+   std::thread writer(writeKmers, std::ref(results), std::cref(parameters), std::cref(models), std::cref(outputs),
+         std::ref(tested_kmers), std::ref(significant_kmers));
+
+   readKmers(kmer_file, parameters, models[0].samples, kmer_queue, results, input_line);
+
+   // Wait for the remaining tests to finish and be written
+   for (auto it = workers.begin(); it != workers.end(); ++it)
+   {
+      it->join();
+   }
+   results.close();
+   writer.join();
+}
+
+// Parse k-mers and apply the basic filters, passing those left on to the
+// pool. The stats filters depend on the phenotype, so are applied there
+void readKmers(DsmReader& kmer_file, const cmdOptions& parameters, const SampleIndex& samples,
+      BoundedQueue<KmerBatch>& kmer_queue, ReorderBuffer<KmerBatch>& results, long int& input_line)
+{
+   KmerBatch batch;
+   batch.batch_nr = 0;
+   batch.kmers.reserve(batch_size);
+
+   Kmer k;
+   while (kmer_file.next_line())
+   {
+      kmer_file.parse(k, samples);
+      k.set_line_nr(++input_line);
+
+      if (!parameters.filter || passBasicFilters(parameters, k))
+      {
+         batch.kmers.push_back(k);
+         if (batch.kmers.size() == batch_size)
+         {
+            sendBatch(batch, kmer_queue, results);
+         }
+      }
+   }
+
+   if (!batch.kmers.empty())
+   {
+      sendBatch(batch, kmer_queue, results);
+   }
+
+   // Lets the pool finish once the queue is empty
+   kmer_queue.close();
+}
+
+// Hands a full batch to the pool, and starts the next one
+void sendBatch(KmerBatch& batch, BoundedQueue<KmerBatch>& kmer_queue, ReorderBuffer<KmerBatch>& results)
+{
+   const long int next_batch = batch.batch_nr + 1;
+
+   // Waits here if too many batches are waiting to be written
+   results.expect(batch.batch_nr);
+   kmer_queue.push(std::move(batch));
+
+   batch.batch_nr = next_batch;
+   batch.kmers.clear();
+   batch.kmers.reserve(batch_size);
+}
+
+// Basic and stats filters, unless turned off
+int passFilters(const cmdOptions& parameters, Kmer& k, const AssocModel& model)
+{
+   return !parameters.filter || (passBasicFilters(parameters, k) && passStatsFilters(parameters, k, model));
+}
+
+// Run the association tests appropriate to each phenotype and the
+// covariates on a batch of k-mers. Those which need a full regression are
+// fitted together
+void testBatch(KmerBatch& batch, const cmdOptions& parameters, const std::vector<AssocModel>& models, arma::mat& x_design)
+{
+   batch.tested.resize(models.size());
+   std::vector<PhenotypeBatch> stages(models.size());
+   for (size_t p = 0; p < models.size(); ++p)
+   {
+      filterBatch(batch.kmers, parameters, models[p], batch.tested[p], stages[p], p + 1 == models.size());
+   }
+
+   ProjectedBatch projected;
+   projectBatch(batch.kmers.size(), models, stages, projected);
+
+   for (size_t p = 0; p < models.size(); ++p)
+   {
+      fitBatch(stages[p].to_fit, stages[p].fit_positions, models[p], x_design, projected);
+
+      for (auto it = stages[p].tested.begin(); it != stages[p].tested.end(); ++it)
+      {
+         finishAssoc(**it, models[p]);
+      }
+
+      for (auto it = stages[p].duplicates.begin(); it != stages[p].duplicates.end(); ++it)
+      {
+         applyResult(storeResult(*it->second), *it->first);
+      }
+      if (models[p].cache != NULL)
+      {
+         models[p].cache->reused(stages[p].duplicates.size());
+      }
+   }
+}
+
+// Copies the k-mers passing the stats filters for a phenotype into tested,
+// then sorts out which of these need fitting. The last phenotype to be
+// filtered moves the k-mers instead, leaving kmers unusable
+void filterBatch(std::vector<Kmer>& kmers, const cmdOptions& parameters, const AssocModel& model,
+      std::vector<Kmer>& tested, PhenotypeBatch& stages, const int last_phenotype)
+{
+   tested.clear();
+   tested.reserve(kmers.size());
+
+   std::vector<size_t> positions;
+   for (size_t j = 0; j < kmers.size(); ++j)
+   {
+      Kmer k = last_phenotype ? std::move(kmers[j]) : kmers[j];
+      if (!parameters.filter || passStatsFilters(parameters, k, model))
+      {
+#ifdef SEER_DEBUG
+         if (parameters.filter)
+         {
+            std::cerr << "kmer " + k.sequence() + " seems significant\n";
+         }
+#endif
+         tested.push_back(std::move(k));
+         positions.push_back(j);
+      }
+   }
+
+   // tested is not added to from here, so pointers into it stay valid.
+   // When caching, a pattern already tested earlier in the batch is not yet
+   // in the cache, so the k-mer takes the earlier result once it is finished
+   std::unordered_map<std::reference_wrapper<const BitVector>, const Kmer*, BitVectorHash, std::equal_to<BitVector>> first_tested;
+   for (size_t i = 0; i < tested.size(); ++i)
+   {
+      auto first = first_tested.find(std::cref(tested[i].presence()));
+      if (first != first_tested.end())
+      {
+         stages.duplicates.push_back(std::make_pair(&tested[i], first->second));
+      }
+      else if (!cachedResult(tested[i], model))
+      {
+         if (model.cache != NULL)
+         {
+            first_tested[std::cref(tested[i].presence())] = &tested[i];
+         }
+         stages.tested.push_back(&tested[i]);
+         if (!scoreScreen(tested[i], model))
+         {
+            stages.to_fit.push_back(&tested[i]);
+            stages.fit_positions.push_back(positions[i]);
+         }
+      }
+   }
+}
+
+// Projects the covariates out of the presence of each k-mer a continuous
+// phenotype needs to fit. This is the costly part of the linear fit (a
+// samples x covariates x k-mers product), so is shared between phenotypes.
+// The k-mers are taken from the phenotypes' tested copies, as the batch
+// itself has been moved from
+void projectBatch(const size_t num_kmers, const std::vector<AssocModel>& models, const std::vector<PhenotypeBatch>& stages,
+      ProjectedBatch& projected)
+{
+   projected.columns.assign(num_kmers, -1);
+
+   const NullModel* null_model = NULL;
+   std::vector<Kmer*> to_project;
+   for (size_t p = 0; p < models.size(); ++p)
+   {
+      if (models[p].continuous && models[p].null_model.q_t.n_elem > 0)
+      {
+         null_model = &models[p].null_model;
+         for (size_t i = 0; i < stages[p].to_fit.size(); ++i)
+         {
+            const size_t position = stages[p].fit_positions[i];
+            if (projected.columns[position] < 0)
+            {
+               projected.columns[position] = to_project.size();
+               to_project.push_back(stages[p].to_fit[i]);
+            }
+         }
+      }
+   }
+
+   if (!to_project.empty())
+   {
+      projected.x_block = presenceMatrix(to_project, null_model->residuals.n_elem);
+
+      const arma::mat qx = null_model->q_t * projected.x_block;
+      projected.sxx = sum(projected.x_block) - sum(square(qx));
+      projected.g = null_model->r_inv * qx;
+   }
+}
+
+// k-mers with the same presence pattern have the same result. Returns 1 if
+// the result was found in the cache
+int cachedResult(Kmer& k, const AssocModel& model)
+{
+   int found = 0;
+
+   AssocResult result;
+   if (model.cache != NULL && model.cache->find(k.presence(), result))
+   {
+      applyResult(result, k);
+      found = 1;
+   }
+
+   return found;
+}
+
+// k-mers far from significant by the score test need not be fitted. Returns
+// 1 if the k-mer was screened out
+int scoreScreen(Kmer& k, const AssocModel& model)
+{
+   int screened_out = 0;
+   if (model.score_test && !model.continuous)
+   {
+      Kmer screened = k;
+      scoreTest(screened, model.null_model);
+      if (screened.p_val() > model.score_cutoff)
+      {
+         k = screened;
+         k.add_comment("score-test");
+         screened_out = 1;
+      }
+   }
+
+   return screened_out;
+}
+
+// Continuous phenotypes with the covariates projected out in the null model
+// can be fitted as a block, as can binary phenotypes with a converged null
+// model. Otherwise each k-mer is fitted in turn
+void fitBatch(const std::vector<Kmer*>& kmers, const std::vector<size_t>& positions, const AssocModel& model,
+      arma::mat& x_design, const ProjectedBatch& projected)
+{
+   if (model.continuous && model.null_model.q_t.n_elem > 0)
+   {
+      linearBatch(kmers, positions, projected, model.null_model);
+   }
+   else if (!model.continuous && model.null_model.design_products.n_elem > 0)
+   {
+      // Those the batch fit could not handle go through the full fitting
+      // procedure, which ends up with Firth regression if need be
+      std::vector<Kmer*> unfitted = logisticBatch(kmers, model.y, model.null_model, model.fit_stats);
+      for (auto it = unfitted.begin(); it != unfitted.end(); ++it)
+      {
+         fitKmer(**it, model, x_design);
+      }
+   }
+   else
+   {
+      for (auto it = kmers.begin(); it != kmers.end(); ++it)
+      {
+         fitKmer(**it, model, x_design);
+      }
+   }
+}
+
+// Full regression of the phenotype on the k-mer and any covariates. Only
+// the k-mer column of the design matrix is overwritten
+void fitKmer(Kmer& k, const AssocModel& model, arma::mat& x_design)
+{
+   fillPresence(k, x_design.colptr(1));
+
+   if (model.continuous)
+   {
+      linearTest(k, model.y, model.null_model, x_design);
+   }
+   else
+   {
+      logisticTest(k, model.y, model.null_model, model.fit_stats, x_design);
+   }
+}
+
+// Design matrix for a thread to fit k-mers with: intercept, k-mer (left
+// empty), then any covariates
+arma::mat designWorkspace(const AssocModel& model)
+{
+   arma::mat x_design(model.y.n_elem, 2, arma::fill::zeros);
+   x_design.col(0).ones();
+   if (model.use_mds)
+   {
+      x_design = arma::join_rows(x_design, model.mds);
+   }
+
+   return x_design;
+}
+
+// Calculate chisq value if not already done so in filtering, and keep the
+// result for later k-mers with the same pattern
+void finishAssoc(Kmer& k, const AssocModel& model)
+{
+   if (k.unadj() == kmer_chi_pvalue_default)
+   {
+      if (model.continuous)
+      {
+         k.unadj_p_val(welchTwoSamplet(k, model.y));
+      }
+      else
+      {
+         k.unadj_p_val(chiTest(k, model.cases));
+      }
+   }
+
+   if (model.cache != NULL)
+   {
+      model.cache->insert(k.presence(), storeResult(k));
+   }
+}
+
+// Each thread in the pool takes batches from the queue until it is closed
+// and empty. The design matrix is the same for every phenotype
+void assocWorker(BoundedQueue<KmerBatch>& kmer_queue, ReorderBuffer<KmerBatch>& results, const cmdOptions& parameters,
+      const std::vector<AssocModel>& models)
+{
+   arma::mat x_design = designWorkspace(models[0]);
+
+   KmerBatch batch;
+   while (kmer_queue.pop(batch))
+   {
+      testBatch(batch, parameters, models, x_design);
+      results.complete(std::move(batch));
+   }
+}
+
+// Writes out tested k-mers as soon as their batch is next in input order,
+// to the output for each phenotype
+void writeKmers(ReorderBuffer<KmerBatch>& results, const cmdOptions& parameters, const std::vector<AssocModel>& models,
+      const std::vector<std::ostream*>& outputs, std::vector<long int>& tested_kmers, std::vector<long int>& significant_kmers)
+{
+   KmerBatch batch;
+   while (results.pop(batch))
+   {
+      for (size_t p = 0; p < models.size(); ++p)
+      {
+         tested_kmers[p] += batch.tested[p].size();
+         for (auto it = batch.tested[p].begin(); it != batch.tested[p].end(); ++it)
+         {
+            significant_kmers[p] += printKmer(*outputs[p], *it, parameters, models[p].samples);
+         }
+      }
+   }
+}
+
+// Column names, with a p-value for each covariate
+void writeHeader(std::ostream& os, const cmdOptions& parameters, const AssocModel& model)
+{
+   os << "sequence\tmaf\tchisq_p_val\twald_p_val\tlrt_p_val\tbeta\tse";
+   if (model.use_mds)
+   {
+      for (unsigned int i = 1; i <= model.mds.n_cols; ++i)
+      {
+         os << "\tcovar" << i << "_p";
+      }
+   }
+   os << "\tcomments";
+   if (parameters.print_samples)
+   {
+      os << "\tsamples_present";
+   }
+   os << std::endl;
+}
+
+// Writes a tested k-mer if it is significant. Returns 1 if written
+int printKmer(std::ostream& os, const Kmer& k, const cmdOptions& parameters, const SampleIndex& samples)
+{
+   int printed = 0;
+   if (!parameters.filter || k.p_val() < parameters.log_cutoff || k.lrt_p_val() < parameters.log_cutoff)
+   {
+      printed = 1;
+
+      os << k;
+      if (parameters.print_samples)
+      {
+         // Names of the samples the k-mer is present in, tab separated
+         os << "\t";
+         const char* separator = "";
+         k.presence().for_each_set([&](const size_t i)
+         {
+            os << separator;
+            samples.write_name(os, i);
+            separator = "\t";
+         });
+      }
+      os << std::endl;
+   }
+
+   return printed;
+}
@@ -10,10 +10,8 @@
 const double normalArea = pow(2*M_PI, -0.5);
 
 // Basic chi^2 test, using contingency table
-double chiTest(Kmer& k, const arma::vec& y)
+double chiTest(Kmer& k, const BitVector& cases)
 {
-   arma::mat x = k.get_x();
-
    double chisq = 0;
 
    // Contigency table
@@ -21,36 +19,21 @@ double chiTest(Kmer& k, const arma::vec& y)
    // present a          b
    // absent  c          d
    //
-   // Use doubles for compatibility with det function in arma::mat
-   double a = 0, b = 0, c = 0, d = 0;
+   // With both the k-mer and the phenotype packed into bits, only two
+   // popcounts are needed. The rest of the table follows from the margins
+   const double N = cases.size();
+   const double present = k.num_occurrences();
+   const double affected = cases.count();
 
-   arma::vec::const_iterator j = y.begin();
-   for (arma::vec::const_iterator i = x.begin(); i!=x.end(); ++i)
-   {
-      if (*j == 0) {
-         if (*i == 0){
-            c++;
-         } else {
-            a++;
-         }
-      } else {
-         if (*i == 0){
-            d++;
-         } else {
-            b++;
-         }
-      }
-      j++;
-   }
+   double b = k.presence().count_and(cases);
+   double a = present - b;
+   double d = affected - b;
+   double c = N - present - d;
 
-   arma::mat::fixed<2, 2> table = {a, b, c, d};
 #ifdef SEER_DEBUG
-   arma::Mat<int>::fixed<2, 2> tab_out = {int (a), int (b), int (c), int(d)};
-   std::cerr << tab_out << "\n";
+   std::cerr << a << "\t" << b << "\n" << c << "\t" << d << "\n";
 #endif
 
-   int N = accu(table);
-
    if (N == 0)
    {
       throw std::logic_error("Empty table for chisq test\n");
@@ -59,9 +42,10 @@ double chiTest(Kmer& k, const arma::vec& y)
    // Treat as invalid if any entry is 0 or 1, or if more than one entry < 5
    // Mark as needing to use Firth regression
    int low_obs = 0;
-   for (auto obs = table.begin(); obs != table.end(); ++obs)
+   const double table[4] = {a, b, c, d};
+   for (int i = 0; i < 4; ++i)
    {
-      if (*obs <= 1 || (*obs <= 5 && ++low_obs > 2))
+      if (table[i] <= 1 || (table[i] <= 5 && ++low_obs > 2))
       {
          k.add_comment("bad-chisq");
          k.firth(1);
@@ -70,11 +54,7 @@ double chiTest(Kmer& k, const arma::vec& y)
    }
 
    // Without Yates' continuity correction
-   chisq = N * pow(det(table), 2);
-   for (int i = 0; i < 2; ++i)
-   {
-      chisq /= accu(table.row(i)) * accu(table.col(i));
-   }
+   chisq = N * pow(a*d - b*c, 2) / ((a + b) * (c + d) * (a + c) * (b + d));
 
    // For df = 1, as here, chi^2 == N(0,1)^2 (standard normal dist.)
    double p_value = normalPval(pow(chisq, 0.5));
@@ -88,11 +68,25 @@ double chiTest(Kmer& k, const arma::vec& y)
 // Welch two sample t-test, for continuous phenotypes
 double welchTwoSamplet(const Kmer& k, const arma::vec& y)
 {
-   arma::mat x = k.get_x();
-
    // Subset into present and absent groups
-   arma::vec group1 = y.elem(find(x==0));
-   arma::vec group2 = y.elem(find(x==1));
+   const BitVector& x = k.presence();
+   std::vector<double> absent, present;
+   present.reserve(k.num_occurrences());
+   absent.reserve(y.n_elem - k.num_occurrences());
+   for (unsigned int i = 0; i < y.n_elem; ++i)
+   {
+      if (x.test(i))
+      {
+         present.push_back(y[i]);
+      }
+      else
+      {
+         absent.push_back(y[i]);
+      }
+   }
+
+   arma::vec group1 = arma::conv_to<arma::vec>::from(absent);
+   arma::vec group2 = arma::conv_to<arma::vec>::from(present);
 
    // Calculate group means and variances
    double p_val = 0;
@@ -127,39 +121,96 @@ double welchTwoSamplet(const Kmer& k, const arma::vec& y)
 }
 
 // Fit null models for null log-likelihoods
-double nullLogLikelihood(const arma::mat& x, const arma::vec& y, const int continuous)
+double nullLogLikelihood(const arma::mat& x, const arma::vec& y, const int continuous, NullModel& null_model)
 {
    double null_ll = 0;
    Kmer null_kmer;
-   if (x.n_cols > 1)
+   null_model.design = x;
+   if (continuous)
    {
-      if (continuous)
+      // Least squares by QR decomposition, keeping the factors so each k-mer
+      // can be fitted by projecting out the covariates
+      arma::mat Q, R, R_inv;
+      if (arma::qr_econ(Q, R, x) && arma::inv(R_inv, arma::trimatu(R)))
+      {
+         null_model.q_t = Q.t();
+         null_model.r_inv = R_inv;
+         null_model.inv_information = R_inv * R_inv.t();
+         null_model.beta = R_inv * (null_model.q_t * y);
+         null_model.residuals = y - x * null_model.beta;
+
+         null_ll = dot(null_model.residuals, null_model.residuals);
+      }
+      else if (x.n_cols > 1)
       {
          doLinear(null_kmer, y, x);
+         null_ll = null_kmer.log_likelihood();
       }
       else
       {
-         doLogit(null_kmer, y, x);
+         dlib::matrix<double,1,1> intercept;
+         intercept(0) = mean(y);
+         LinearLikelihood likelihood_fit(x, y);
+         null_ll = 2*likelihood_fit(intercept);
       }
-      null_ll = null_kmer.log_likelihood();
    }
    else
    {
-      dlib::matrix<double,1,1> intercept;
+      // Newton-Raphson, keeping the fitted values for the score test
+      // null is: intercept = log-odds of success, which is already the
+      // maximum likelihood estimate without covariates
+      arma::vec b = arma::zeros(x.n_cols);
+      b(0) = log(mean(y)/(1-mean(y)));
 
-      if (continuous)
+      int converged = (x.n_cols == 1);
+      for (unsigned int i = 0; i < max_nr_iterations && !converged; ++i)
       {
-         intercept(0) = mean(y);
-         LinearLikelihood likelihood_fit(x, y);
-         null_ll = 2*likelihood_fit(intercept);
+         arma::vec y_pred = predictLogitProbs(x, b);
+         arma::mat var_covar_mat = inv_covar(weightedGram(x, y_pred % (1 - y_pred)));
+         if (var_covar_mat.n_elem == 0)
+         {
+            break;
+         }
+
+         arma::vec step = var_covar_mat * (x.t() * (y - y_pred));
+         b += step;
+
+         converged = max(abs(step)) < convergence_limit;
       }
-      else
+
+      if (converged)
       {
-         intercept(0) = log(mean(y)/(1-mean(y))); // null is: intercept = log-odds of success
          LogitLikelihood likelihood_fit(x, y);
-         null_ll = likelihood_fit(intercept);
+         null_ll = likelihood_fit(arma_to_dlib(b));
+
+         arma::vec y_pred = predictLogitProbs(x, b);
+         null_model.beta = b;
+         null_model.residuals = y - y_pred;
+         null_model.weights = y_pred % (1 - y_pred);
+         null_model.weighted_design_t = (x.each_col() % null_model.weights).t();
+         null_model.inv_information = inv_covar(weightedGram(x, null_model.weights));
+
+         // The information matrix of a batch of fits is then a single matrix
+         // product with their weights
+         null_model.design_products.set_size(x.n_rows, x.n_cols * (x.n_cols + 1) / 2);
+         unsigned int pair = 0;
+         for (unsigned int a = 0; a < x.n_cols; ++a)
+         {
+            for (unsigned int b_col = a; b_col < x.n_cols; ++b_col)
+            {
+               null_model.design_products.col(pair++) = x.col(a) % x.col(b_col);
+            }
+         }
+      }
+      else
+      {
+         // Fall back to the more careful fitting used for each k-mer
+         doLogit(null_kmer, y, x);
+         null_ll = null_kmer.log_likelihood();
       }
    }
+
+   null_model.log_likelihood = null_ll;
    return null_ll;
 }
 
@@ -189,7 +240,7 @@ double likelihoodRatioTest(Kmer& k, const double null_ll, const int continuous)
          // 10.2478/v10048-009-0003-9
          // Exact Likelihood Ratio Test for the Parameters of the Linear
          // Regression Model with Normal Errors
-         lrt = k.get_x().n_rows * (1-log_likelihood/null_ll);
+         lrt = k.presence().size() * (1-log_likelihood/null_ll);
       }
       else
       {
@@ -232,17 +283,40 @@ double normalPval(double testStatistic)
    return p_val;
 }
 
-int passStatsFilters(const cmdOptions& filterOptions, Kmer& k, const arma::vec& y, const int continuous_phenotype)
+// Stacks the presence vectors of k-mers as the columns of a 0/1 matrix
+arma::mat presenceMatrix(const std::vector<Kmer*>& kmers, const size_t num_samples)
+{
+   arma::mat x_block(num_samples, kmers.size(), arma::fill::zeros);
+   for (size_t j = 0; j < kmers.size(); ++j)
+   {
+      fillPresence(*kmers[j], x_block.colptr(j));
+   }
+
+   return x_block;
+}
+
+// Writes the presence vector of a k-mer as 0s and 1s into col, which must
+// have an entry for every sample
+void fillPresence(const Kmer& k, double* col)
+{
+   std::fill(col, col + k.presence().size(), 0.0);
+   k.presence().for_each_set([col](const size_t i)
+   {
+      col[i] = 1;
+   });
+}
+
+int passStatsFilters(const cmdOptions& filterOptions, Kmer& k, const AssocModel& model)
 {
    int passed = 1;
 
-   if (continuous_phenotype)
+   if (model.continuous)
    {
-      k.unadj_p_val(welchTwoSamplet(k, y));
+      k.unadj_p_val(welchTwoSamplet(k, model.y));
    }
    else
    {
-      k.unadj_p_val(chiTest(k, y));
+      k.unadj_p_val(chiTest(k, model.cases));
    }
 
    if (k.unadj() > filterOptions.chi_cutoff)
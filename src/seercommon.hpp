@@ -37,8 +37,15 @@
 
 // Classes
 #include "kmer.hpp"
+#include "bitMatrix.hpp"
 #include "sample.hpp"
 #include "covar.hpp"
+#include "sampleIndex.hpp"
+#include "bgzfReader.hpp"
+#include "binaryDsm.hpp"
+#include "binaryDsmReader.hpp"
+#include "binaryDsmWriter.hpp"
+#include "dsmReader.hpp"
 
 // Constants
 const std::string VERSION = "1.1.4";
@@ -56,16 +63,24 @@ struct cmdOptions
 {
    double log_cutoff;
    double chi_cutoff;
+   double score_cutoff;
 
    long int max_length;
    long int size;
+   long int cache_size;
    int filter;
    int pc;
    int print_samples;
+   int dedup_patterns;
+   int fit_stats;
+   int score_test;
    int write_distances;
    unsigned int num_threads;
+   unsigned int seed;
    size_t min_words;
    size_t max_words;
+   uint64_t region_start;
+   uint64_t region_end;
 
    std::string pheno;
    std::string kmers;
@@ -76,6 +91,7 @@ struct cmdOptions
 //    seerCommon.cpp
 cmdOptions verifyCommandLine(boost::program_options::variables_map& vm, const std::vector<Sample>& samples);
 void verifyMDSOptions(cmdOptions& verified, boost::program_options::variables_map& vm);
+void parseRegion(const std::string& region, uint64_t& start, uint64_t& end);
 
 arma::vec dlib_to_arma(const column_vector& dlib_vec);
 column_vector arma_to_dlib(const arma::vec& arma_vec);
@@ -84,16 +100,23 @@ void normaliseMatCols(arma::mat& matrix_in);
 
 int continuousPhenotype (const std::vector<Sample>& sample_list);
 
-arma::mat inv_covar(arma::mat A);
+arma::mat inv_covar(const arma::mat& A);
+arma::mat weightedGram(const arma::mat& x, const arma::vec& w);
 
 // seerErr headers
 void badCommand(const std::string& command, const std::string& value);
 
 // seerIO headers
-void readPheno(const std::string& filename, std::vector<Sample>& samples, std::unordered_map<std::string,int>& sample_map);
+void readPheno(const std::string& filename, std::vector<Sample>& samples);
+std::vector<std::string> readPhenoList(const std::string& filename);
+int sameSamples(const std::vector<Sample>& samples_1, const std::vector<Sample>& samples_2);
+std::string phenotypeName(const std::string& pheno_file);
 void openDsmFile(igzstream& dsm_file, const std::string& file_name);
+int gzippedFile(const std::string& file_name);
+int regularFile(const std::string& file_name);
 
 arma::vec constructVecY(const std::vector<Sample>& samples);
+BitVector constructCaseMask(const arma::vec& y);
 arma::vec constructVecX(const Kmer& k, const std::vector<Sample>& samples);
 
 arma::mat readHDF5(const std::string& file_name);
@@ -0,0 +1,35 @@
+/*
+ * stopStrategy.hpp
+ * Header file for the stop strategy used with the dlib optimisers
+ */
+
+#include <dlib/optimization.h>
+
+// dlib's objective_delta_stop_strategy, which also counts the iterations
+// taken. dlib passes stop strategies by value, so the count is written to a
+// variable owned by the caller
+class CountingStopStrategy
+{
+   public:
+      // Initialisation
+      CountingStopStrategy(const double min_delta, unsigned long& iterations)
+         : _stop(min_delta), _iterations(iterations)
+      {
+         _iterations = 0;
+      }
+
+      template <typename T>
+      bool should_continue_search(const T& x, const double funct_value, const T& funct_derivative)
+      {
+         bool keep_going = _stop.should_continue_search(x, funct_value, funct_derivative);
+         if (keep_going)
+         {
+            ++_iterations;
+         }
+         return keep_going;
+      }
+
+   private:
+      dlib::objective_delta_stop_strategy _stop;
+      unsigned long& _iterations;
+};
@@ -0,0 +1,161 @@
+/*
+ * threadQueue.hpp
+ * Header file for the queues used to pass k-mers between threads
+ *
+ */
+
+#include <deque>
+#include <utility>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+
+// A fixed capacity FIFO. push blocks when full, pop blocks when empty
+// Once closed, pop drains the remaining items then returns false
+template <class T>
+class BoundedQueue
+{
+   public:
+      // Initialisation
+      BoundedQueue(const size_t capacity)
+         : _capacity(capacity), _closed(0)
+      {
+      }
+
+      // Modifying operations
+      void push(const T& item)
+      {
+         std::unique_lock<std::mutex> lock(_mutex);
+         _not_full.wait(lock, [this]{ return _items.size() < _capacity; });
+
+         _items.push_back(item);
+         _not_empty.notify_one();
+      }
+
+      void push(T&& item)
+      {
+         std::unique_lock<std::mutex> lock(_mutex);
+         _not_full.wait(lock, [this]{ return _items.size() < _capacity; });
+
+         _items.push_back(std::move(item));
+         _not_empty.notify_one();
+      }
+
+      bool pop(T& item)
+      {
+         std::unique_lock<std::mutex> lock(_mutex);
+         _not_empty.wait(lock, [this]{ return !_items.empty() || _closed; });
+
+         int popped = 0;
+         if (!_items.empty())
+         {
+            item = std::move(_items.front());
+            _items.pop_front();
+            popped = 1;
+
+            _not_full.notify_one();
+         }
+
+         return popped;
+      }
+
+      void close()
+      {
+         std::lock_guard<std::mutex> lock(_mutex);
+         _closed = 1;
+         _not_empty.notify_all();
+      }
+
+   private:
+      std::deque<T> _items;
+      size_t _capacity;
+      int _closed;
+
+      std::mutex _mutex;
+      std::condition_variable _not_full;
+      std::condition_variable _not_empty;
+};
+
+// Restores input order of items completed out of order by a pool of threads.
+// Items are keyed on their input line number, which must be registered with
+// expect() in input order before the item is handed to a worker. expect
+// blocks while capacity items are outstanding
+template <class T>
+class ReorderBuffer
+{
+   public:
+      // Initialisation
+      ReorderBuffer(const size_t capacity)
+         : _capacity(capacity), _closed(0)
+      {
+      }
+
+      // Modifying operations
+      void expect(const long int line_nr)
+      {
+         std::unique_lock<std::mutex> lock(_mutex);
+         _not_full.wait(lock, [this]{ return _order.size() < _capacity; });
+
+         _order.push_back(line_nr);
+      }
+
+      void complete(T&& item)
+      {
+         std::lock_guard<std::mutex> lock(_mutex);
+         const long int line_nr = item.line_number();
+         _done[line_nr] = std::move(item);
+
+         if (!_order.empty() && line_nr == _order.front())
+         {
+            _next_ready.notify_all();
+         }
+      }
+
+      // Waits for the next item in input order. Returns false once closed and
+      // no items remain
+      bool pop(T& item)
+      {
+         std::unique_lock<std::mutex> lock(_mutex);
+         _next_ready.wait(lock, [this]{ return (!_order.empty() && _done.count(_order.front())) || (_order.empty() && _closed); });
+
+         return take_front(item);
+      }
+
+      void close()
+      {
+         std::lock_guard<std::mutex> lock(_mutex);
+         _closed = 1;
+         _next_ready.notify_all();
+      }
+
+   private:
+      // Must be called with the lock held
+      bool take_front(T& item)
+      {
+         int taken = 0;
+         if (!_order.empty())
+         {
+            auto done_it = _done.find(_order.front());
+            if (done_it != _done.end())
+            {
+               item = std::move(done_it->second);
+               _done.erase(done_it);
+               _order.pop_front();
+               taken = 1;
+
+               _not_full.notify_one();
+            }
+         }
+
+         return taken;
+      }
+
+      std::deque<long int> _order;
+      std::unordered_map<long int, T> _done;
+      size_t _capacity;
+      int _closed;
+
+      std::mutex _mutex;
+      std::condition_variable _not_full;
+      std::condition_variable _next_ready;
+};
@@ -37,6 +37,37 @@ sub do_test($$$$)
    return($fail);
 }
 
+# Options which should not change the results are tested by comparing the
+# output with that of a run without them. Timings and counts go to stderr, so
+# only the output is compared
+sub do_compare($$$$)
+{
+   my ($command, $reference, $num, $name) = @_;
+
+   my $fail = 0;
+
+   my $outfile = tmpnam();
+   my $reffile = tmpnam();
+   system("($command) > $outfile 2> /dev/null");
+   system("($reference) > $reffile 2> /dev/null");
+
+   my $outdiff = `diff -q $outfile $reffile`;
+   if ($outdiff ne "" || -z $reffile)
+   {
+      print STDERR "FAILED test $num, $name\n";
+      print STDERR $outdiff . "\n";
+      $fail = 1;
+   }
+   else
+   {
+      print STDERR "PASSED test $num, $name\n";
+   }
+
+   unlink($outfile, $reffile);
+
+   return($fail);
+}
+
 $exit_status = do_test("$seer_location/seer -k example_kmers.gz -p subset.pheno", "test1", 1, "basic filters");
 $exit_status= $exit_status || do_test("$seer_location/seer -k example_kmers.gz -p subset.pheno --pval 1 --chisq 1", "test2", 2, "binary phenotype assocation");
 $exit_status = $exit_status || do_test("$seer_location/seer -k example_kmers.gz -p subset.pheno --pval 1 --chisq 1 --maf 0.1 --print_samples", "test3", 3, "print output");
@@ -45,6 +76,16 @@ $exit_status = $exit_status || do_test("$seer_location/seer -k example_kmers.gz
 $exit_status = $exit_status || do_test("$seer_location/seer -k example_kmers.gz -p subset.pheno --covar_file covariates.txt --covar_list 2q,3 --pval 1 --chisq 1", "test6", 6, "assocation with covariates");
 $exit_status = $exit_status || do_test("$seer_location/filter_seer -k filter_in.txt --pos_beta", "test7", 7, "filter output");
 $exit_status = $exit_status || do_test("$seer_location/map_back -k map_in.txt -r assembly_locations.txt --threads 1", "test8", 8, "map k-mers");
+$exit_status = $exit_status || do_compare("$seer_location/dsm2bin -k example_kmers.gz -p subset.pheno -o example_kmers.bin && $seer_location/seer -k example_kmers.bin -p subset.pheno --pval 1 --chisq 1", "$seer_location/seer -k example_kmers.gz -p subset.pheno --pval 1 --chisq 1", 9, "binary k-mer file");
+$exit_status = $exit_status || do_compare("$seer_location/dsm2bin -k example_kmers.gz -p subset.pheno -o example_kmers.bin 2>&1 > /dev/null | grep -c '^WARNING: Dropped'", "echo 1", 10, "warn about samples not in the pheno file");
+$exit_status = $exit_status || do_compare("$seer_location/seer -k example_kmers.bgz -p subset.pheno --pval 1 --chisq 1 --threads 2 --region :2164327400 && $seer_location/seer -k example_kmers.bgz -p subset.pheno --pval 1 --chisq 1 --threads 2 --region 2164327400:2621440000 | tail -n +2 && $seer_location/seer -k example_kmers.bgz -p subset.pheno --pval 1 --chisq 1 --threads 2 --region 2621440000: | tail -n +2", "$seer_location/seer -k example_kmers.gz -p subset.pheno --pval 1 --chisq 1", 11, "regions of bgzipped k-mer file");
+$exit_status = $exit_status || do_compare("$seer_location/seer -k example_kmers.gz -p subset.pheno --pval 1 --chisq 1 --dedup_patterns", "$seer_location/seer -k example_kmers.gz -p subset.pheno --pval 1 --chisq 1", 12, "deduplicated presence patterns");
+$exit_status = $exit_status || do_compare("$seer_location/seer -k example_kmers.gz -p subset.pheno --pval 1 --chisq 1 --score_test 0.05 > score_test.txt && grep -v score-test score_test.txt", "grep score-test score_test.txt | cut -f1 > score_screened.txt && test -s score_screened.txt && $seer_location/seer -k example_kmers.gz -p subset.pheno --pval 1 --chisq 1 | grep -v -w -F -f score_screened.txt", 13, "score test screening");
+$exit_status = $exit_status || do_compare("$seer_location/seer -k example_kmers.gz --pheno_list pheno_list.txt --pval 1 --chisq 1 --maf 0.1 -o pheno_list_test && cat pheno_list_test.subset.txt pheno_list_test.subset.cont.txt", "$seer_location/seer -k example_kmers.gz -p subset.pheno --pval 1 --chisq 1 --maf 0.1 && $seer_location/seer -k example_kmers.gz -p subset.cont.pheno --pval 1 --chisq 1 --maf 0.1", 14, "multiple phenotypes");
+$exit_status = $exit_status || do_compare("$seer_location/kmds -k example_kmers.bin -p subset.pheno --no_filtering --size 1000 --seed 7 --threads 2 --write_distances -o kmds_shards && cat kmds_shardsdistances.csv", "$seer_location/kmds -k example_kmers.gz -p subset.pheno --no_filtering --size 1000 --write_distances -o kmds_single && cat kmds_singledistances.csv", 15, "kmds shards");
+$exit_status = $exit_status || do_compare("$seer_location/kmds -k example_kmers.bin -p subset.pheno --no_filtering --size 50 --seed 7 --threads 2 --write_distances -o kmds_seed_a && cat kmds_seed_adistances.csv", "$seer_location/kmds -k example_kmers.bin -p subset.pheno --no_filtering --size 50 --seed 7 --threads 2 --write_distances -o kmds_seed_b && cat kmds_seed_bdistances.csv", 16, "kmds seed");
+
+unlink(glob("example_kmers.bin score_test.txt score_screened.txt pheno_list_test.* kmds_*"));
 
 exit($exit_status);
 